@@ -0,0 +1,84 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Steps through a list of configurations inside the render loop. Each step gets a few
+// warm-up frames and then a fixed number of measured frames; a table is printed at the end.
+class FrameBenchmark
+{
+public:
+    explicit FrameBenchmark(std::string title, unsigned int warmupFrames = 30, unsigned int measuredFrames = 120)
+        : title(title), warmupFrames(warmupFrames), measuredFrames(measuredFrames)
+    {
+    }
+
+    void AddStep(const std::string &label)
+    {
+        steps.push_back({label, {}});
+    }
+
+    bool Running() const { return current < steps.size(); }
+    unsigned int Step() const { return current; }
+
+    // records one frame, returns true when the next step starts and the scene has to be reconfigured
+    bool Frame(double frameTimeMs)
+    {
+        if (!Running())
+            return false;
+        frame++;
+        if (frame <= warmupFrames)
+            return false;
+        steps[current].times.push_back(frameTimeMs);
+        if (steps[current].times.size() < measuredFrames)
+            return false;
+
+        frame = 0;
+        current++;
+        if (!Running())
+            Print();
+        return Running();
+    }
+
+    void Print() const
+    {
+        std::cout << title << " benchmark, " << measuredFrames << " frames per step" << std::endl;
+        std::cout << std::setw(12) << "step" << std::setw(12) << "avg ms" << std::setw(12) << "min ms"
+                  << std::setw(12) << "p95 ms" << std::setw(12) << "max ms" << std::endl;
+        for (const StepResult &step : steps)
+        {
+            if (step.times.empty())
+                continue;
+            std::vector<double> sorted = step.times;
+            std::sort(sorted.begin(), sorted.end());
+            double sum = 0.0;
+            for (double time : sorted)
+                sum += time;
+            std::cout << std::fixed << std::setprecision(3)
+                      << std::setw(12) << step.label
+                      << std::setw(12) << sum / sorted.size()
+                      << std::setw(12) << sorted.front()
+                      << std::setw(12) << sorted[(sorted.size() - 1) * 95 / 100]
+                      << std::setw(12) << sorted.back() << std::endl;
+        }
+    }
+
+private:
+    struct StepResult {
+        std::string label;
+        std::vector<double> times;
+    };
+
+    std::string title;
+    unsigned int warmupFrames;
+    unsigned int measuredFrames;
+    std::vector<StepResult> steps;
+    unsigned int current = 0;
+    unsigned int frame = 0;
+};
+
+#endif
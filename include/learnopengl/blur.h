@@ -0,0 +1,123 @@
+#ifndef BLUR_H
+#define BLUR_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/render_targets.h>
+#include <learnopengl/shader.h>
+
+#include <cmath>
+
+// Dual Kawase blur over a chain of half, quarter, ... resolution targets. Each downsample pass
+// reads 5 bilinear taps and each upsample pass 8, the way back up ends directly in the target
+// framebuffer at full size. The level targets come from a RenderTargetPool and go back to it
+// after every Apply(), so they follow the size of the source and are shared with other passes.
+//
+// The radius picks the number of levels and the tap offset in the smallest one. Every extra level
+// has a quarter of the pixels of the one before it, so a larger radius costs about the same.
+class BlurChain
+{
+public:
+    static const unsigned int MAX_LEVELS = 5;
+
+    // in full resolution pixels
+    float radius = 8.0f;
+
+    BlurChain(RenderTargetPool &pool, unsigned int quadVAO)
+        : downShader("resources/shaders/framebuffers.vs", "resources/shaders/blur_down.fs"),
+          upShader("resources/shaders/framebuffers.vs", "resources/shaders/blur_up.fs"),
+          pool(pool), quadVAO(quadVAO)
+    {
+        for (Shader *shader : {&downShader, &upShader})
+        {
+            shader->use();
+            shader->setInt("source", 0);
+        }
+        downTexelSize = downShader.uniform<glm::vec2>("texelSize");
+        downOffset = downShader.uniform<float>("offset");
+        downSourceScale = downShader.uniform<glm::vec2>("sourceScale");
+        upTexelSize = upShader.uniform<glm::vec2>("texelSize");
+        upOffset = upShader.uniform<float>("offset");
+    }
+
+    // how many levels the current radius goes down, the offset is about 1 to 2 texels of the smallest
+    unsigned int Levels() const
+    {
+        int levels = (int)std::floor(std::log2(std::fmax(radius, 4.0f) * 0.5f));
+        return (unsigned int)std::min(std::max(levels, 1), (int)MAX_LEVELS);
+    }
+
+    // blurs source, a width x height texture, into targetFramebuffer at the current viewport.
+    // sourceScale is the part of source that holds the picture. Depth testing has to be off
+    void Apply(unsigned int source, unsigned int width, unsigned int height, unsigned int targetFramebuffer,
+               const glm::vec2 &sourceScale = glm::vec2(1.0f))
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        unsigned int levels = Levels();
+        for (unsigned int i = 0; i < levels; i++)
+        {
+            sizes[i] = glm::ivec2(std::max(width >> (i + 1), 1u), std::max(height >> (i + 1), 1u));
+            textures[i] = pool.Acquire({(unsigned int)sizes[i].x, (unsigned int)sizes[i].y, GL_RGB8});
+            framebuffers[i] = pool.Framebuffer({textures[i]});
+        }
+        float offset = radius / (float)(2 << levels);
+        glBindVertexArray(quadVAO);
+        glActiveTexture(GL_TEXTURE0);
+
+        downShader.use();
+        downShader.set(downOffset, offset);
+        glm::vec2 sourceTexel(1.0f / width, 1.0f / height);
+        unsigned int sourceTexture = source;
+        for (unsigned int i = 0; i < levels; i++)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+            glViewport(0, 0, sizes[i].x, sizes[i].y);
+            downShader.set(downTexelSize, sourceTexel);
+            downShader.set(downSourceScale, i == 0 ? sourceScale : glm::vec2(1.0f));
+            glBindTexture(GL_TEXTURE_2D, sourceTexture);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            sourceTexture = textures[i];
+            sourceTexel = texelSize(i);
+        }
+
+        upShader.use();
+        upShader.set(upOffset, offset);
+        for (unsigned int i = levels - 1; i > 0; i--)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i - 1]);
+            glViewport(0, 0, sizes[i - 1].x, sizes[i - 1].y);
+            upShader.set(upTexelSize, texelSize(i));
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        upShader.set(upTexelSize, texelSize(0));
+        glBindTexture(GL_TEXTURE_2D, textures[0]);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        for (unsigned int i = 0; i < levels; i++)
+            pool.Release(textures[i]);
+    }
+
+private:
+    Shader downShader;
+    Shader upShader;
+    Shader::Uniform<glm::vec2> downTexelSize, upTexelSize, downSourceScale;
+    Shader::Uniform<float> downOffset, upOffset;
+    RenderTargetPool &pool;
+    unsigned int quadVAO;
+    // of the current Apply()
+    unsigned int framebuffers[MAX_LEVELS];
+    unsigned int textures[MAX_LEVELS];
+    glm::ivec2 sizes[MAX_LEVELS];
+
+    glm::vec2 texelSize(unsigned int level) const
+    {
+        return glm::vec2(1.0f / sizes[level].x, 1.0f / sizes[level].y);
+    }
+};
+
+#endif
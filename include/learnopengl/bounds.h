@@ -0,0 +1,151 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <cmath>
+
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    AABB() {}
+    AABB(const glm::vec3 &min, const glm::vec3 &max) : min(min), max(max) {}
+
+    bool Valid() const { return min.x <= max.x; }
+    glm::vec3 Center() const { return (min + max) * 0.5f; }
+    glm::vec3 Extents() const { return (max - min) * 0.5f; }
+    float SurfaceArea() const
+    {
+        glm::vec3 size = max - min;
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    void Grow(const glm::vec3 &point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+    void Grow(const AABB &box)
+    {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+
+    // box around the transformed box (Arvo), tighter than transforming the eight corners' box
+    AABB Transform(const glm::mat4 &m) const
+    {
+        glm::vec3 center = glm::vec3(m * glm::vec4(Center(), 1.0f));
+        glm::vec3 extents = Extents();
+        glm::vec3 newExtents;
+        for (int i = 0; i < 3; i++)
+            newExtents[i] = std::fabs(m[0][i]) * extents.x + std::fabs(m[1][i]) * extents.y + std::fabs(m[2][i]) * extents.z;
+        return AABB(center - newExtents, center + newExtents);
+    }
+};
+
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    BoundingSphere() {}
+    BoundingSphere(const glm::vec3 &center, float radius) : center(center), radius(radius) {}
+
+    // scales the radius by the largest axis scale, so non-uniform scaling stays conservative
+    BoundingSphere Transform(const glm::mat4 &m) const
+    {
+        float scale2 = std::fmax(glm::dot(glm::vec3(m[0]), glm::vec3(m[0])),
+                                 std::fmax(glm::dot(glm::vec3(m[1]), glm::vec3(m[1])), glm::dot(glm::vec3(m[2]), glm::vec3(m[2]))));
+        return BoundingSphere(glm::vec3(m * glm::vec4(center, 1.0f)), radius * std::sqrt(scale2));
+    }
+};
+
+inline bool Overlaps(const AABB &box, const BoundingSphere &sphere)
+{
+    glm::vec3 closest = glm::clamp(sphere.center, box.min, box.max);
+    glm::vec3 offset = closest - sphere.center;
+    return glm::dot(offset, offset) <= sphere.radius * sphere.radius;
+}
+
+// slab test, returns the distance the ray enters the box at or FLT_MAX when it misses within maxDistance
+inline float IntersectRay(const AABB &box, const glm::vec3 &origin, const glm::vec3 &inverseDirection, float maxDistance)
+{
+    glm::vec3 t0 = (box.min - origin) * inverseDirection;
+    glm::vec3 t1 = (box.max - origin) * inverseDirection;
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+    float enter = std::fmax(std::fmax(tNear.x, tNear.y), std::fmax(tNear.z, 0.0f));
+    float exit = std::fmin(std::fmin(tFar.x, tFar.y), std::fmin(tFar.z, maxDistance));
+    return enter <= exit ? enter : FLT_MAX;
+}
+
+// planes point inwards: a point p is inside when dot(normal, p) + d >= 0 for all six
+class Frustum
+{
+public:
+    glm::vec4 planes[6];
+
+    Frustum() {}
+
+    // extracts the planes from a view-projection matrix (Gribb/Hartmann)
+    explicit Frustum(const glm::mat4 &viewProjection)
+    {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        planes[0] = rows[3] + rows[0];  // left
+        planes[1] = rows[3] - rows[0];  // right
+        planes[2] = rows[3] + rows[1];  // bottom
+        planes[3] = rows[3] - rows[1];  // top
+        planes[4] = rows[3] + rows[2];  // near
+        planes[5] = rows[3] - rows[2];  // far
+        for (glm::vec4 &plane : planes)
+            plane /= glm::length(glm::vec3(plane));
+    }
+
+    bool Intersects(const BoundingSphere &sphere) const
+    {
+        for (const glm::vec4 &plane : planes)
+            if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+                return false;
+        return true;
+    }
+
+    // conservative: boxes near a frustum corner may pass although they are outside
+    bool Intersects(const AABB &box) const
+    {
+        for (const glm::vec4 &plane : planes)
+        {
+            // the corner furthest along the plane normal
+            glm::vec3 positive(plane.x >= 0.0f ? box.max.x : box.min.x,
+                               plane.y >= 0.0f ? box.max.y : box.min.y,
+                               plane.z >= 0.0f ? box.max.z : box.min.z);
+            if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    // true when the whole box is inside, so nothing below it has to be tested
+    bool Contains(const AABB &box) const
+    {
+        for (const glm::vec4 &plane : planes)
+        {
+            // the corner furthest against the plane normal
+            glm::vec3 negative(plane.x >= 0.0f ? box.min.x : box.max.x,
+                               plane.y >= 0.0f ? box.min.y : box.max.y,
+                               plane.z >= 0.0f ? box.min.z : box.max.z);
+            if (glm::dot(glm::vec3(plane), negative) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+struct CullStats {
+    unsigned int drawn = 0;
+    unsigned int culled = 0;
+};
+
+#endif
@@ -0,0 +1,466 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/bounds.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <functional>
+#include <vector>
+
+// children of an inner node are stored next to each other at first and first + 1,
+// a leaf (count > 0) owns items [first, first + count)
+struct BVHNode {
+    AABB bounds;
+    unsigned int first = 0;
+    unsigned int count = 0;
+
+    bool IsLeaf() const { return count > 0; }
+};
+
+struct BVHHit {
+    unsigned int userData = 0;
+    float distance = FLT_MAX;
+};
+
+// Bounding volume hierarchy over world space boxes, built with the binned surface area heuristic.
+// Objects are added, moved and removed by id; Update() rebuilds after objects were added or removed
+// and otherwise only refits the boxes of moved objects bottom-up, falling back to a rebuild once the
+// refitted tree got much worse than a fresh one. Queries report the userData of the objects they find.
+class BVH
+{
+public:
+    static const unsigned int BIN_COUNT = 16;
+    static const unsigned int MAX_LEAF_SIZE = 4;
+    // leaves this small are kept when splitting would not pay off by the SAH
+    static const unsigned int MAX_SAH_LEAF_SIZE = 16;
+    static const unsigned int MAX_DEPTH = 64;
+
+    // how often Update() had to rebuild or could refit
+    unsigned int builds = 0;
+    unsigned int refits = 0;
+
+    unsigned int Add(const AABB &bounds, unsigned int userData)
+    {
+        unsigned int id;
+        if (!freeIds.empty())
+        {
+            id = freeIds.back();
+            freeIds.pop_back();
+            objectBounds[id] = bounds;
+            objectUserData[id] = userData;
+            alive[id] = true;
+        }
+        else
+        {
+            id = objectBounds.size();
+            objectBounds.push_back(bounds);
+            objectUserData.push_back(userData);
+            alive.push_back(true);
+        }
+        needsBuild = true;
+        return id;
+    }
+
+    void Move(unsigned int id, const AABB &bounds)
+    {
+        objectBounds[id] = bounds;
+        if (id < moved.size() && !moved[id])
+        {
+            moved[id] = true;
+            movedIds.push_back(id);
+        }
+        needsRefit = true;
+    }
+
+    void Remove(unsigned int id)
+    {
+        alive[id] = false;
+        freeIds.push_back(id);
+        needsBuild = true;
+    }
+
+    void Clear()
+    {
+        objectBounds.clear();
+        objectUserData.clear();
+        alive.clear();
+        freeIds.clear();
+        needsBuild = true;
+    }
+
+    unsigned int ObjectCount() const { return objectBounds.size() - freeIds.size(); }
+    unsigned int NodeCount() const { return nodes.size(); }
+    const AABB &Bounds(unsigned int id) const { return objectBounds[id]; }
+    unsigned int UserData(unsigned int id) const { return objectUserData[id]; }
+
+    // call once per frame after moving objects and before querying
+    void Update()
+    {
+        if (needsBuild)
+            Build();
+        else if (needsRefit)
+            Refit();
+    }
+
+    void Build()
+    {
+        items.clear();
+        for (unsigned int id = 0; id < alive.size(); id++)
+            if (alive[id])
+                items.push_back(id);
+        centroids.resize(objectBounds.size());
+        for (unsigned int id : items)
+            centroids[id] = objectBounds[id].Center();
+
+        nodes.clear();
+        nodes.reserve(2 * items.size() + 1);
+        BVHNode root;
+        root.count = items.size();
+        nodes.push_back(root);
+
+        if (!items.empty())
+        {
+            // explicit stack of (node, depth), the tree can be deep for clustered scenes
+            std::vector<std::pair<unsigned int, unsigned int>> stack;
+            stack.push_back(std::make_pair(0u, 0u));
+            while (!stack.empty())
+            {
+                std::pair<unsigned int, unsigned int> entry = stack.back();
+                stack.pop_back();
+                if (split(entry.first, entry.second))
+                {
+                    stack.push_back(std::make_pair(nodes[entry.first].first, entry.second + 1));
+                    stack.push_back(std::make_pair(nodes[entry.first].first + 1, entry.second + 1));
+                }
+            }
+        }
+
+        // where every object sits, so Refit() can walk up from the moved ones only
+        parents.assign(nodes.size(), 0);
+        objectLeaves.assign(objectBounds.size(), 0);
+        for (unsigned int i = 0; i < nodes.size(); i++)
+        {
+            const BVHNode &node = nodes[i];
+            if (node.IsLeaf())
+            {
+                for (unsigned int k = node.first; k < node.first + node.count; k++)
+                    objectLeaves[items[k]] = i;
+            }
+            else if (!items.empty())
+            {
+                parents[node.first] = parents[node.first + 1] = i;
+            }
+        }
+        moved.assign(objectBounds.size(), false);
+        movedIds.clear();
+
+        buildCost = cost();
+        needsBuild = needsRefit = false;
+        builds++;
+    }
+
+    // recomputes the boxes of the leaves holding moved objects and of their ancestors. Children always
+    // come after their parent, so going through those nodes from the back fits children first
+    void Refit()
+    {
+        needsRefit = false;
+        if (items.empty())
+        {
+            movedIds.clear();
+            return;
+        }
+        dirtyNodes.clear();
+        nodeDirty.assign(nodes.size(), false);
+        for (unsigned int id : movedIds)
+        {
+            moved[id] = false;
+            if (!alive[id])
+                continue;
+            // stops at the first node an earlier object already marked, everything above it is marked too
+            for (unsigned int node = objectLeaves[id];; node = parents[node])
+            {
+                if (nodeDirty[node])
+                    break;
+                nodeDirty[node] = true;
+                dirtyNodes.push_back(node);
+                if (node == 0)
+                    break;
+            }
+        }
+        movedIds.clear();
+        std::sort(dirtyNodes.begin(), dirtyNodes.end());
+        for (unsigned int i = dirtyNodes.size(); i-- > 0;)
+        {
+            BVHNode &node = nodes[dirtyNodes[i]];
+            node.bounds = AABB();
+            if (node.IsLeaf())
+            {
+                for (unsigned int k = node.first; k < node.first + node.count; k++)
+                    node.bounds.Grow(objectBounds[items[k]]);
+            }
+            else
+            {
+                node.bounds.Grow(nodes[node.first].bounds);
+                node.bounds.Grow(nodes[node.first + 1].bounds);
+            }
+        }
+        refits++;
+
+        // moved objects make nodes overlap more and more, start over when queries would suffer
+        if (cost() > 2.0f * buildCost)
+            Build();
+    }
+
+    void QueryFrustum(const Frustum &frustum, std::vector<unsigned int> &result) const
+    {
+        if (items.empty())
+            return;
+        unsigned int stack[MAX_DEPTH];
+        unsigned int size = 0;
+        stack[size++] = 0;
+        while (size > 0)
+        {
+            const BVHNode &node = nodes[stack[--size]];
+            if (!frustum.Intersects(node.bounds))
+                continue;
+            if (frustum.Contains(node.bounds))
+            {
+                appendSubtree(node, result);
+                continue;
+            }
+            if (node.IsLeaf())
+            {
+                for (unsigned int k = node.first; k < node.first + node.count; k++)
+                    if (frustum.Intersects(objectBounds[items[k]]))
+                        result.push_back(objectUserData[items[k]]);
+                continue;
+            }
+            stack[size++] = node.first;
+            stack[size++] = node.first + 1;
+        }
+    }
+
+    void QuerySphere(const BoundingSphere &sphere, std::vector<unsigned int> &result) const
+    {
+        if (items.empty())
+            return;
+        unsigned int stack[MAX_DEPTH];
+        unsigned int size = 0;
+        stack[size++] = 0;
+        while (size > 0)
+        {
+            const BVHNode &node = nodes[stack[--size]];
+            if (!Overlaps(node.bounds, sphere))
+                continue;
+            if (node.IsLeaf())
+            {
+                for (unsigned int k = node.first; k < node.first + node.count; k++)
+                    if (Overlaps(objectBounds[items[k]], sphere))
+                        result.push_back(objectUserData[items[k]]);
+                continue;
+            }
+            stack[size++] = node.first;
+            stack[size++] = node.first + 1;
+        }
+    }
+
+    // closest object whose box the ray enters within maxDistance. narrowPhase, when given, gets the
+    // userData and the box entry distance and can reject the object or move the hit further along.
+    bool Raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, BVHHit &hit,
+                 const std::function<bool(unsigned int, float &)> &narrowPhase = nullptr) const
+    {
+        hit = BVHHit();
+        if (items.empty())
+            return false;
+        glm::vec3 inverseDirection = 1.0f / direction;
+        float closest = maxDistance;
+
+        // nodes with the distance their box is entered at, the nearer child is visited first
+        std::pair<unsigned int, float> stack[MAX_DEPTH];
+        unsigned int size = 0;
+        float rootDistance = IntersectRay(nodes[0].bounds, origin, inverseDirection, closest);
+        if (rootDistance < closest)
+            stack[size++] = std::make_pair(0u, rootDistance);
+        while (size > 0)
+        {
+            std::pair<unsigned int, float> entry = stack[--size];
+            if (entry.second >= closest)
+                continue;
+            const BVHNode &node = nodes[entry.first];
+            if (node.IsLeaf())
+            {
+                for (unsigned int k = node.first; k < node.first + node.count; k++)
+                {
+                    unsigned int id = items[k];
+                    float distance = IntersectRay(objectBounds[id], origin, inverseDirection, closest);
+                    if (distance >= closest)
+                        continue;
+                    if (narrowPhase && (!narrowPhase(objectUserData[id], distance) || distance >= closest))
+                        continue;
+                    closest = distance;
+                    hit.userData = objectUserData[id];
+                    hit.distance = distance;
+                }
+                continue;
+            }
+            float left = IntersectRay(nodes[node.first].bounds, origin, inverseDirection, closest);
+            float right = IntersectRay(nodes[node.first + 1].bounds, origin, inverseDirection, closest);
+            std::pair<unsigned int, float> nearChild(node.first, left), farChild(node.first + 1, right);
+            if (right < left)
+                std::swap(nearChild, farChild);
+            if (farChild.second < closest)
+                stack[size++] = farChild;
+            if (nearChild.second < closest)
+                stack[size++] = nearChild;
+        }
+        return hit.distance < FLT_MAX;
+    }
+
+private:
+    struct Bin {
+        AABB bounds;
+        unsigned int count = 0;
+    };
+
+    std::vector<AABB> objectBounds;
+    std::vector<unsigned int> objectUserData;
+    std::vector<bool> alive;
+    std::vector<unsigned int> freeIds;
+    std::vector<glm::vec3> centroids;
+    // object ids in leaf order, so every subtree owns a contiguous range
+    std::vector<unsigned int> items;
+    std::vector<BVHNode> nodes;
+    // parent of every node and leaf of every object, from the last Build()
+    std::vector<unsigned int> parents;
+    std::vector<unsigned int> objectLeaves;
+    // objects moved since the last Update(), and the nodes Refit() has to fit again
+    std::vector<bool> moved;
+    std::vector<unsigned int> movedIds;
+    std::vector<unsigned int> dirtyNodes;
+    std::vector<bool> nodeDirty;
+    float buildCost = 0.0f;
+    bool needsBuild = true;
+    bool needsRefit = false;
+
+    static unsigned int binIndex(float centroid, float lowest, float scale)
+    {
+        unsigned int bin = (unsigned int)((centroid - lowest) * scale);
+        return bin < BIN_COUNT - 1 ? bin : BIN_COUNT - 1;
+    }
+
+    // fits the node around its items and splits it at the cheapest bin boundary, returns false for leaves
+    bool split(unsigned int nodeIndex, unsigned int depth)
+    {
+        unsigned int first = nodes[nodeIndex].first;
+        unsigned int count = nodes[nodeIndex].count;
+        AABB bounds, centroidBounds;
+        for (unsigned int k = first; k < first + count; k++)
+        {
+            bounds.Grow(objectBounds[items[k]]);
+            centroidBounds.Grow(centroids[items[k]]);
+        }
+        nodes[nodeIndex].bounds = bounds;
+        if (count <= MAX_LEAF_SIZE || depth + 1 >= MAX_DEPTH)
+            return false;
+
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        unsigned int bestBin = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float lowest = centroidBounds.min[axis];
+            float extent = centroidBounds.max[axis] - lowest;
+            if (extent <= 0.0f)
+                continue;
+            float scale = BIN_COUNT / extent;
+
+            Bin bins[BIN_COUNT];
+            for (unsigned int k = first; k < first + count; k++)
+            {
+                Bin &bin = bins[binIndex(centroids[items[k]][axis], lowest, scale)];
+                bin.count++;
+                bin.bounds.Grow(objectBounds[items[k]]);
+            }
+
+            // sweep from both sides, split i puts bins [0, i) on the left
+            float leftArea[BIN_COUNT];
+            unsigned int leftCount[BIN_COUNT];
+            AABB left;
+            unsigned int leftTotal = 0;
+            for (unsigned int i = 1; i < BIN_COUNT; i++)
+            {
+                left.Grow(bins[i - 1].bounds);
+                leftTotal += bins[i - 1].count;
+                leftArea[i] = leftTotal > 0 ? left.SurfaceArea() : 0.0f;
+                leftCount[i] = leftTotal;
+            }
+            AABB right;
+            unsigned int rightTotal = 0;
+            for (unsigned int i = BIN_COUNT - 1; i > 0; i--)
+            {
+                right.Grow(bins[i].bounds);
+                rightTotal += bins[i].count;
+                if (leftCount[i] == 0 || rightTotal == 0)
+                    continue;
+                float splitCost = leftCount[i] * leftArea[i] + rightTotal * right.SurfaceArea();
+                if (splitCost < bestCost)
+                {
+                    bestCost = splitCost;
+                    bestAxis = axis;
+                    bestBin = i;
+                }
+            }
+        }
+
+        // a node test costs about as much as an object test, so a split costs one more box test
+        float area = bounds.SurfaceArea();
+        if (bestAxis < 0 || (count <= MAX_SAH_LEAF_SIZE && area + bestCost >= count * area))
+            return false;
+
+        float lowest = centroidBounds.min[bestAxis];
+        float scale = BIN_COUNT / (centroidBounds.max[bestAxis] - lowest);
+        std::vector<unsigned int>::iterator middle = std::partition(items.begin() + first, items.begin() + first + count,
+            [&](unsigned int id) { return binIndex(centroids[id][bestAxis], lowest, scale) < bestBin; });
+        unsigned int leftCount = middle - (items.begin() + first);
+
+        BVHNode left, right;
+        left.first = first;
+        left.count = leftCount;
+        right.first = first + leftCount;
+        right.count = count - leftCount;
+        nodes[nodeIndex].first = nodes.size();
+        nodes[nodeIndex].count = 0;
+        nodes.push_back(left);
+        nodes.push_back(right);
+        return true;
+    }
+
+    // expected cost of a query relative to testing the root box
+    float cost() const
+    {
+        if (nodes.empty() || !nodes[0].bounds.Valid())
+            return 0.0f;
+        float total = 0.0f;
+        for (const BVHNode &node : nodes)
+            total += node.bounds.SurfaceArea() * (node.IsLeaf() ? node.count : 1);
+        float rootArea = nodes[0].bounds.SurfaceArea();
+        return rootArea > 0.0f ? total / rootArea : 0.0f;
+    }
+
+    // the leaves of a subtree cover consecutive items, from its leftmost to its rightmost leaf
+    void appendSubtree(const BVHNode &node, std::vector<unsigned int> &result) const
+    {
+        const BVHNode *leftmost = &node, *rightmost = &node;
+        while (!leftmost->IsLeaf())
+            leftmost = &nodes[leftmost->first];
+        while (!rightmost->IsLeaf())
+            rightmost = &nodes[rightmost->first + 1];
+        for (unsigned int k = leftmost->first; k < rightmost->first + rightmost->count; k++)
+            result.push_back(objectUserData[items[k]]);
+    }
+};
+
+#endif
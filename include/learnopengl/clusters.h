@@ -0,0 +1,321 @@
+#ifndef CLUSTERS_H
+#define CLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/lights.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/thread_pool.h>
+#include <learnopengl/uniform_blocks.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+// texture units of the clustered light data, above the units materials use
+enum ClusterTextureUnit {
+    CLUSTER_UNIT_POINT_LIGHTS = 5,
+    CLUSTER_UNIT_GRID = 6,
+    CLUSTER_UNIT_LIGHT_INDICES = 7
+};
+
+// std140 layout of the ClusterData block in light_clustered.fs
+struct GpuClusterData {
+    unsigned int gridSize[4];
+    glm::vec4 clusterParams;  // tile width, tile height in pixels, slice scale, slice bias
+};
+
+struct ClusterStats {
+    unsigned int visibleLights = 0;
+    unsigned int lightIndices = 0;
+    unsigned int maxLightsPerCluster = 0;
+    unsigned int overflowedClusters = 0;
+    double assignMs = 0.0;
+};
+
+// Clustered forward shading: the view frustum is cut into GRID_X x GRID_Y screen tiles and GRID_Z
+// exponential depth slices. Every frame the point lights are assigned to the clusters their bounding
+// sphere touches, the slices are spread over the thread pool and each light is tested against four
+// clusters at a time with SSE. The result goes to two texture buffers: (offset, count) per cluster
+// and the flat list of light indices they point into.
+class ClusteredLighting
+{
+public:
+    static const unsigned int GRID_X = 16;
+    static const unsigned int GRID_Y = 9;
+    static const unsigned int GRID_Z = 24;
+    static const unsigned int CLUSTERS_PER_SLICE = GRID_X * GRID_Y;
+    static const unsigned int CLUSTER_COUNT = CLUSTERS_PER_SLICE * GRID_Z;
+    static const unsigned int MAX_LIGHTS_PER_CLUSTER = 256;
+
+    ClusterStats stats;
+
+    explicit ClusteredLighting(ThreadPool &pool) : pool(pool)
+    {
+        createTextureBuffer(gridTBO, gridTexture, GL_RG32UI);
+        createTextureBuffer(indexTBO, indexTexture, GL_R32UI);
+
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(GpuClusterData), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_CLUSTERS, UBO);
+
+        minX.resize(CLUSTER_COUNT); minY.resize(CLUSTER_COUNT); minZ.resize(CLUSTER_COUNT);
+        maxX.resize(CLUSTER_COUNT); maxY.resize(CLUSTER_COUNT); maxZ.resize(CLUSTER_COUNT);
+        clusterCounts.resize(CLUSTER_COUNT);
+        clusterLights.resize(CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER);
+        grid.resize(2 * CLUSTER_COUNT);
+        sliceLights.resize(GRID_Z);
+    }
+
+    // points the light data samplers of a clustered program at their texture units
+    void SetupShader(Shader &shader) const
+    {
+        shader.use();
+        shader.setInt("pointLightData", CLUSTER_UNIT_POINT_LIGHTS);
+        shader.setInt("clusterGrid", CLUSTER_UNIT_GRID);
+        shader.setInt("clusterLightIndices", CLUSTER_UNIT_LIGHT_INDICES);
+    }
+
+    // assigns the lights to clusters, the projection parameters have to match the ones used for rendering.
+    // candidates, when given, lists the indices of the lights worth testing, e.g. the ones a BVH found in the frustum
+    void Update(const glm::mat4 &view, float fovY, float aspect, float nearPlane, float farPlane,
+                unsigned int viewportWidth, unsigned int viewportHeight, const std::vector<PointLight> &lights,
+                const std::vector<unsigned int> *candidates = nullptr)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+        if (fovY != this->fovY || aspect != this->aspect || nearPlane != this->nearPlane || farPlane != this->farPlane
+            || viewportWidth != this->viewportWidth || viewportHeight != this->viewportHeight)
+            buildClusterBounds(fovY, aspect, nearPlane, farPlane, viewportWidth, viewportHeight);
+
+        // view space bounding spheres, bucketed by the depth slices they overlap
+        viewLights.clear();
+        for (std::vector<unsigned int> &slice : sliceLights)
+            slice.clear();
+        unsigned int candidateCount = candidates ? candidates->size() : lights.size();
+        for (unsigned int n = 0; n < candidateCount; n++)
+        {
+            unsigned int i = candidates ? (*candidates)[n] : n;
+            glm::vec3 center = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+            float radius = PointLightRadius(lights[i]);
+            float depth = -center.z;
+            if (depth + radius < nearPlane || depth - radius > farPlane)
+                continue;
+            unsigned int first = slice(depth - radius);
+            unsigned int last = slice(depth + radius);
+            for (unsigned int k = first; k <= last; k++)
+                sliceLights[k].push_back(viewLights.size());
+            viewLights.push_back({center, radius, i});
+        }
+
+        pool.ParallelFor(GRID_Z, [this](unsigned int begin, unsigned int end) {
+            for (unsigned int k = begin; k < end; k++)
+                assignSlice(k);
+        });
+
+        // compact the per-cluster lists into one index list
+        stats = ClusterStats();
+        stats.visibleLights = viewLights.size();
+        lightIndices.clear();
+        for (unsigned int cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+        {
+            unsigned int count = clusterCounts[cluster];
+            if (count > MAX_LIGHTS_PER_CLUSTER)
+            {
+                stats.overflowedClusters++;
+                count = MAX_LIGHTS_PER_CLUSTER;
+            }
+            if (count > stats.maxLightsPerCluster)
+                stats.maxLightsPerCluster = count;
+            grid[2 * cluster] = lightIndices.size();
+            grid[2 * cluster + 1] = count;
+            const unsigned int *list = &clusterLights[cluster * MAX_LIGHTS_PER_CLUSTER];
+            lightIndices.insert(lightIndices.end(), list, list + count);
+        }
+        stats.lightIndices = lightIndices.size();
+        if (lightIndices.empty())
+            lightIndices.push_back(0);
+
+        // orphan the old storage, the previous frame may still be reading it
+        glBindBuffer(GL_TEXTURE_BUFFER, gridTBO);
+        glBufferData(GL_TEXTURE_BUFFER, grid.size() * sizeof(unsigned int), &grid[0], GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, indexTBO);
+        glBufferData(GL_TEXTURE_BUFFER, lightIndices.size() * sizeof(unsigned int), &lightIndices[0], GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        stats.assignMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    void Bind(const LightManager &lights) const
+    {
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_UNIT_POINT_LIGHTS);
+        glBindTexture(GL_TEXTURE_BUFFER, lights.PointLightTexture());
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_UNIT_GRID);
+        glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_UNIT_LIGHT_INDICES);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    struct ViewLight {
+        glm::vec3 center;
+        float radius;
+        unsigned int index;
+    };
+
+    ThreadPool &pool;
+    unsigned int gridTBO, gridTexture;
+    unsigned int indexTBO, indexTexture;
+    unsigned int UBO;
+
+    float fovY = 0.0f, aspect = 0.0f, nearPlane = 0.0f, farPlane = 0.0f;
+    unsigned int viewportWidth = 0, viewportHeight = 0;
+    float sliceScale = 0.0f, sliceBias = 0.0f;
+
+    // view space cluster bounds, structure of arrays so four clusters load at once
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+    std::vector<ViewLight> viewLights;
+    std::vector<std::vector<unsigned int>> sliceLights;
+    std::vector<unsigned int> clusterCounts;
+    std::vector<unsigned int> clusterLights;
+    std::vector<unsigned int> grid;
+    std::vector<unsigned int> lightIndices;
+
+    static void createTextureBuffer(unsigned int &buffer, unsigned int &texture, GLenum format)
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(unsigned int) * 2, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    unsigned int slice(float depth) const
+    {
+        if (depth <= nearPlane)
+            return 0;
+        int k = (int)std::floor(std::log(depth) * sliceScale + sliceBias);
+        return k < 0 ? 0 : (k >= (int)GRID_Z ? GRID_Z - 1 : k);
+    }
+
+    void buildClusterBounds(float fovY, float aspect, float nearPlane, float farPlane,
+                            unsigned int viewportWidth, unsigned int viewportHeight)
+    {
+        this->fovY = fovY;
+        this->aspect = aspect;
+        this->nearPlane = nearPlane;
+        this->farPlane = farPlane;
+        this->viewportWidth = viewportWidth;
+        this->viewportHeight = viewportHeight;
+        float logDepthRange = std::log(farPlane / nearPlane);
+        sliceScale = GRID_Z / logDepthRange;
+        sliceBias = -(float)GRID_Z * std::log(nearPlane) / logDepthRange;
+
+        float tanHalfY = std::tan(fovY * 0.5f);
+        float tanHalfX = tanHalfY * aspect;
+        for (unsigned int k = 0; k < GRID_Z; k++)
+        {
+            float sliceNear = nearPlane * std::pow(farPlane / nearPlane, (float)k / GRID_Z);
+            float sliceFar = nearPlane * std::pow(farPlane / nearPlane, (float)(k + 1) / GRID_Z);
+            for (unsigned int y = 0; y < GRID_Y; y++)
+            {
+                float ndcY0 = -1.0f + 2.0f * y / GRID_Y;
+                float ndcY1 = -1.0f + 2.0f * (y + 1) / GRID_Y;
+                for (unsigned int x = 0; x < GRID_X; x++)
+                {
+                    float ndcX0 = -1.0f + 2.0f * x / GRID_X;
+                    float ndcX1 = -1.0f + 2.0f * (x + 1) / GRID_X;
+                    unsigned int cluster = x + y * GRID_X + k * CLUSTERS_PER_SLICE;
+                    // the tile's side planes go through the eye, so the corners at both depths bound it
+                    minX[cluster] = std::fmin(ndcX0 * sliceNear, ndcX0 * sliceFar) * tanHalfX;
+                    maxX[cluster] = std::fmax(ndcX1 * sliceNear, ndcX1 * sliceFar) * tanHalfX;
+                    minY[cluster] = std::fmin(ndcY0 * sliceNear, ndcY0 * sliceFar) * tanHalfY;
+                    maxY[cluster] = std::fmax(ndcY1 * sliceNear, ndcY1 * sliceFar) * tanHalfY;
+                    minZ[cluster] = -sliceFar;
+                    maxZ[cluster] = -sliceNear;
+                }
+            }
+        }
+
+        GpuClusterData data;
+        data.gridSize[0] = GRID_X;
+        data.gridSize[1] = GRID_Y;
+        data.gridSize[2] = GRID_Z;
+        data.gridSize[3] = 0;
+        data.clusterParams = glm::vec4((float)viewportWidth / GRID_X, (float)viewportHeight / GRID_Y, sliceScale, sliceBias);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(GpuClusterData), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void addLight(unsigned int cluster, unsigned int light)
+    {
+        unsigned int count = clusterCounts[cluster]++;
+        if (count < MAX_LIGHTS_PER_CLUSTER)
+            clusterLights[cluster * MAX_LIGHTS_PER_CLUSTER + count] = light;
+    }
+
+    // sphere vs box test of every light touching slice k against the slice's clusters,
+    // slices never share clusters so threads can write their lists without locking
+    void assignSlice(unsigned int k)
+    {
+        unsigned int base = k * CLUSTERS_PER_SLICE;
+        for (unsigned int c = 0; c < CLUSTERS_PER_SLICE; c++)
+            clusterCounts[base + c] = 0;
+
+        for (unsigned int lightIndex : sliceLights[k])
+        {
+            const ViewLight &light = viewLights[lightIndex];
+#if defined(__SSE2__)
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 cx = _mm_set1_ps(light.center.x);
+            const __m128 cy = _mm_set1_ps(light.center.y);
+            const __m128 cz = _mm_set1_ps(light.center.z);
+            const __m128 radius2 = _mm_set1_ps(light.radius * light.radius);
+            for (unsigned int c = 0; c < CLUSTERS_PER_SLICE; c += 4)
+            {
+                unsigned int i = base + c;
+                // distance from the center to the box along each axis, zero inside
+                __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[i]), cx), zero),
+                                       _mm_max_ps(_mm_sub_ps(cx, _mm_loadu_ps(&maxX[i])), zero));
+                __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[i]), cy), zero),
+                                       _mm_max_ps(_mm_sub_ps(cy, _mm_loadu_ps(&maxY[i])), zero));
+                __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[i]), cz), zero),
+                                       _mm_max_ps(_mm_sub_ps(cz, _mm_loadu_ps(&maxZ[i])), zero));
+                __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                int mask = _mm_movemask_ps(_mm_cmple_ps(distance2, radius2));
+                while (mask)
+                {
+                    int bit = __builtin_ctz(mask);
+                    mask &= mask - 1;
+                    addLight(i + bit, light.index);
+                }
+            }
+#else
+            float radius2 = light.radius * light.radius;
+            for (unsigned int c = 0; c < CLUSTERS_PER_SLICE; c++)
+            {
+                unsigned int i = base + c;
+                float dx = std::fmax(minX[i] - light.center.x, 0.0f) + std::fmax(light.center.x - maxX[i], 0.0f);
+                float dy = std::fmax(minY[i] - light.center.y, 0.0f) + std::fmax(light.center.y - maxY[i], 0.0f);
+                float dz = std::fmax(minZ[i] - light.center.z, 0.0f) + std::fmax(light.center.z - maxZ[i], 0.0f);
+                if (dx * dx + dy * dy + dz * dz <= radius2)
+                    addLight(i, light.index);
+            }
+#endif
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/lights.h>
+#include <learnopengl/render_targets.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/shader_permutations.h>
+#include <learnopengl/shadows.h>
+
+#include <cmath>
+#include <vector>
+
+// Deferred shading path. The geometry pass (light.vs + gbuffer.fs) writes a compact G-buffer:
+//   0: RGBA8   albedo, specular intensity
+//   1: RG16    octahedral encoded normal
+//   depth:     DEPTH24_STENCIL8 texture, positions are reconstructed from it
+// Resolve() then accumulates the directional light with a fullscreen quad and every point light
+// with an instanced sphere sized to the light's radius, into the scene framebuffer.
+// The G-buffer targets are taken from a RenderTargetPool for the geometry pass and handed back
+// after Resolve(), at the size last given to Resize().
+class DeferredRenderer
+{
+public:
+    // geometry pass variants, including the ones for meshes drawn with an InstanceBuffer
+    ShaderPermutations geometryShaders;
+
+    DeferredRenderer(RenderTargetPool &pool, ShaderRegistry &shaders, unsigned int width, unsigned int height,
+                     unsigned int quadVAO)
+        : geometryShaders(shaders, "resources/shaders/light.vs", "resources/shaders/gbuffer.fs"),
+          dirShader("resources/shaders/framebuffers.vs", "resources/shaders/deferred_dir.fs"),
+          pointShader("resources/shaders/deferred_point.vs", "resources/shaders/deferred_point.fs"),
+          pool(pool), width(width), height(height), quadVAO(quadVAO)
+    {
+        createSphere();
+
+        for (Shader *shader : {&dirShader, &pointShader})
+        {
+            shader->use();
+            shader->setInt("gAlbedoSpec", 0);
+            shader->setInt("gNormal", 1);
+            shader->setInt("gDepth", 2);
+        }
+        pointShader.setInt("pointLightData", 3);
+        CascadedShadowMaps::SetupShader(dirShader);
+        SetRenderSize(width, height);
+    }
+
+    // size of the scene framebuffer Resolve() writes to, the render size goes back to all of it
+    void Resize(unsigned int width, unsigned int height)
+    {
+        if (width == this->width && height == this->height)
+            return;
+        this->width = width;
+        this->height = height;
+        renderWidth = renderHeight = 0;
+        SetRenderSize(width, height);
+    }
+
+    // part of the G-buffer the geometry pass renders into, the viewport has to match. Smaller than
+    // the full size with dynamic resolution
+    void SetRenderSize(unsigned int renderWidth, unsigned int renderHeight)
+    {
+        if (renderWidth == this->renderWidth && renderHeight == this->renderHeight)
+            return;
+        this->renderWidth = renderWidth;
+        this->renderHeight = renderHeight;
+        glm::vec2 uvScale((float)renderWidth / width, (float)renderHeight / height);
+        dirShader.use();
+        dirShader.setVec2("uvScale", uvScale);
+        pointShader.use();
+        pointShader.setVec2("uvScale", uvScale);
+        pointShader.setVec2("screenSize", glm::vec2((float)renderWidth, (float)renderHeight));
+    }
+
+    // binds and clears the G-buffer for the geometry pass
+    void BeginGeometry()
+    {
+        gAlbedoSpec = pool.Acquire({width, height, GL_RGBA8, 1, GL_NEAREST});
+        gNormal = pool.Acquire({width, height, GL_RG16, 1, GL_NEAREST});
+        gDepth = pool.Acquire({width, height, GL_DEPTH24_STENCIL8, 1, GL_NEAREST});
+        gBuffer = pool.Framebuffer({gAlbedoSpec, gNormal}, gDepth);
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    }
+
+    // lights the G-buffer into targetFramebuffer and copies the depth over, so forward
+    // geometry and the skybox can be drawn on top afterwards
+    void Resolve(unsigned int targetFramebuffer, const LightManager &lights)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFramebuffer);
+        glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, renderWidth, renderHeight, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, gAlbedoSpec);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, gNormal);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, gDepth);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_BUFFER, lights.PointLightTexture());
+
+        glDisable(GL_DEPTH_TEST);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+
+        dirShader.use();
+        glBindVertexArray(quadVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        // back faces, so the volume still covers the screen when the camera is inside it
+        if (lights.PointLightCount() > 0)
+        {
+            glCullFace(GL_FRONT);
+            pointShader.use();
+            glBindVertexArray(sphereVAO);
+            glDrawElementsInstanced(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0, lights.PointLightCount());
+            glCullFace(GL_BACK);
+        }
+
+        glBindVertexArray(0);
+        glDisable(GL_BLEND);
+        glDepthMask(GL_TRUE);
+        glEnable(GL_DEPTH_TEST);
+        glActiveTexture(GL_TEXTURE0);
+
+        pool.Release(gAlbedoSpec);
+        pool.Release(gNormal);
+        pool.Release(gDepth);
+    }
+
+private:
+    Shader dirShader;
+    Shader pointShader;
+    RenderTargetPool &pool;
+    unsigned int width, height;
+    unsigned int renderWidth = 0, renderHeight = 0;
+    unsigned int quadVAO;
+    unsigned int gBuffer;
+    unsigned int gAlbedoSpec, gNormal, gDepth;
+    unsigned int sphereVAO, sphereVBO, sphereEBO;
+    unsigned int sphereIndexCount;
+
+    // unit UV sphere, slightly enlarged so its flat faces stay outside the real sphere
+    void createSphere()
+    {
+        const unsigned int rings = 8, segments = 12;
+        const float scale = 1.0f / std::cos(glm::radians(180.0f) / segments);
+        std::vector<float> vertices;
+        for (unsigned int ring = 0; ring <= rings; ring++)
+        {
+            float theta = glm::radians(180.0f) * ring / rings;
+            for (unsigned int segment = 0; segment <= segments; segment++)
+            {
+                float phi = glm::radians(360.0f) * segment / segments;
+                vertices.push_back(scale * std::sin(theta) * std::cos(phi));
+                vertices.push_back(scale * std::cos(theta));
+                vertices.push_back(scale * std::sin(theta) * std::sin(phi));
+            }
+        }
+        // counter-clockwise seen from outside
+        std::vector<unsigned int> indices;
+        for (unsigned int ring = 0; ring < rings; ring++)
+        {
+            for (unsigned int segment = 0; segment < segments; segment++)
+            {
+                unsigned int a = ring * (segments + 1) + segment;
+                unsigned int b = a + segments + 1;
+                indices.insert(indices.end(), {a, a + 1, b, b, a + 1, b + 1});
+            }
+        }
+        sphereIndexCount = indices.size();
+
+        glGenVertexArrays(1, &sphereVAO);
+        glGenBuffers(1, &sphereVBO);
+        glGenBuffers(1, &sphereEBO);
+        glBindVertexArray(sphereVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glBindVertexArray(0);
+    }
+};
+
+#endif
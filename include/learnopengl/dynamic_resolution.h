@@ -0,0 +1,136 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+struct DynamicResolutionStats {
+    float scale = 1.0f;
+    // GPU time of the frame the controller last saw, a few frames old
+    double gpuMs = 0.0;
+    double frameMs = 0.0;
+    double targetMs = 0.0;
+    // how often the render size changed so far
+    unsigned int changes = 0;
+};
+
+// Scales the part of the scene target that is rendered into so the GPU frame time stays at targetMs.
+// The frame is timed with a pair of GL_TIMESTAMP queries, read back a few frames later so the CPU never
+// waits on them. A PID controller in velocity form moves a continuous scale, the render size only
+// follows it in SCALE_STEP increments and not more often than every few frames, so small swings in
+// frame time do not make the picture pump.
+//
+// The scene target keeps its full size, only the viewport shrinks. Passes that read the scene back
+// multiply their texture coordinates by UvScale().
+class DynamicResolution
+{
+public:
+    static const unsigned int QUERY_FRAMES = 4;
+    static constexpr float SCALE_STEP = 0.05f;
+
+    double targetMs = 1000.0 / 60.0;
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+    // relative frame time error inside which the controller holds still
+    float deadband = 0.05f;
+    // frames between two size changes, dropping resolution is allowed sooner than raising it
+    unsigned int raiseDelay = 15;
+    unsigned int dropDelay = 4;
+    float kp = 0.1f, ki = 0.04f, kd = 0.02f;
+
+    DynamicResolutionStats stats;
+
+    DynamicResolution(unsigned int width, unsigned int height)
+        : width(width), height(height)
+    {
+        glGenQueries(2 * QUERY_FRAMES, &queries[0][0]);
+    }
+
+    // call before the first draw of the frame
+    void BeginFrame()
+    {
+        glQueryCounter(queries[queryFrame][0], GL_TIMESTAMP);
+    }
+
+    // call after the last draw of the frame, frameMs is the CPU side frame time
+    void EndFrame(double frameMs)
+    {
+        glQueryCounter(queries[queryFrame][1], GL_TIMESTAMP);
+        issued[queryFrame] = true;
+        queryFrame = (queryFrame + 1) % QUERY_FRAMES;
+        stats.frameMs = frameMs;
+        stats.targetMs = targetMs;
+        framesSinceChange++;
+
+        // the oldest pair, which the next BeginFrame reuses
+        if (!issued[queryFrame])
+            return;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[queryFrame][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(queries[queryFrame][0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(queries[queryFrame][1], GL_QUERY_RESULT, &end);
+        stats.gpuMs = (double)(end - begin) / 1000000.0;
+        control(stats.gpuMs);
+    }
+
+    // size of the full target, after a window resize
+    void Resize(unsigned int width, unsigned int height)
+    {
+        this->width = width;
+        this->height = height;
+    }
+
+    float Scale() const { return scale; }
+    unsigned int Width() const { return scaled(width); }
+    unsigned int Height() const { return scaled(height); }
+    // part of the full size target that holds the scene
+    glm::vec2 UvScale() const { return glm::vec2((float)Width() / width, (float)Height() / height); }
+
+private:
+    unsigned int width, height;
+    unsigned int queries[QUERY_FRAMES][2];
+    bool issued[QUERY_FRAMES] = {};
+    unsigned int queryFrame = 0;
+
+    // what the controller asks for and what is rendered at
+    float desiredScale = 1.0f;
+    float scale = 1.0f;
+    float lastError = 0.0f, lastLastError = 0.0f;
+    unsigned int framesSinceChange = 0;
+
+    void control(double gpuMs)
+    {
+        // positive when there is time left in the budget
+        float error = (float)((targetMs - gpuMs) / targetMs);
+        if (std::fabs(error) < deadband)
+            error = 0.0f;
+        float delta = kp * (error - lastError) + ki * error + kd * (error - 2.0f * lastError + lastLastError);
+        lastLastError = lastError;
+        lastError = error;
+        desiredScale = std::fmin(std::fmax(desiredScale + delta, minScale), maxScale);
+
+        float next = std::round(desiredScale / SCALE_STEP) * SCALE_STEP;
+        next = std::fmin(std::fmax(next, minScale), maxScale);
+        if (std::fabs(next - scale) < SCALE_STEP * 0.5f)
+            return;
+        if (framesSinceChange < (next < scale ? dropDelay : raiseDelay))
+            return;
+        scale = next;
+        stats.scale = scale;
+        stats.changes++;
+        framesSinceChange = 0;
+    }
+
+    unsigned int scaled(unsigned int size) const
+    {
+        unsigned int result = (unsigned int)std::lround(size * scale);
+        return result > 0 ? result : 1;
+    }
+};
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef ECS_H
+#define ECS_H
+
+#include <learnopengl/thread_pool.h>
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+// Sparse set entity-component storage. Every component type has its own pool with the components
+// packed in one array, entities index into it through a sparse array. Adding and removing are O(1),
+// removal moves the last component into the hole so the array never has gaps.
+//
+// An entity is its slot in the low 24 bits and the slot's generation in the high 8 bits, so a
+// handle of a destroyed entity stops being Valid() even after its slot is reused.
+typedef uint32_t Entity;
+const Entity NULL_ENTITY = 0xFFFFFFFFu;
+
+inline unsigned int EntityIndex(Entity entity) { return entity & 0xFFFFFFu; }
+inline unsigned int EntityGeneration(Entity entity) { return entity >> 24; }
+
+class ComponentPoolBase
+{
+public:
+    virtual ~ComponentPoolBase() {}
+    virtual bool Has(Entity entity) const = 0;
+    virtual void Remove(Entity entity) = 0;
+};
+
+template <typename T>
+class ComponentPool : public ComponentPoolBase
+{
+public:
+    // replaces the entity's component if it has one. nullptr if the slot holds the component of another
+    // generation, which means entity is a stale handle
+    T *Add(Entity entity, const T &component)
+    {
+        unsigned int index = EntityIndex(entity);
+        if (index >= sparse.size())
+            sparse.resize(index + 1, EMPTY);
+        if (sparse[index] != EMPTY)
+        {
+            if (dense[sparse[index]] != entity)
+            {
+                std::cout << "ERROR::ECS::ADD_TO_STALE_ENTITY " << EntityIndex(entity) << std::endl;
+                return nullptr;
+            }
+            components[sparse[index]] = component;
+            return &components[sparse[index]];
+        }
+        sparse[index] = dense.size();
+        dense.push_back(entity);
+        components.push_back(component);
+        return &components.back();
+    }
+
+    bool Has(Entity entity) const override
+    {
+        unsigned int index = EntityIndex(entity);
+        return index < sparse.size() && sparse[index] != EMPTY && dense[sparse[index]] == entity;
+    }
+
+    void Remove(Entity entity) override
+    {
+        if (!Has(entity))
+            return;
+        unsigned int slot = sparse[EntityIndex(entity)];
+        unsigned int last = dense.size() - 1;
+        if (slot != last)
+        {
+            dense[slot] = dense[last];
+            components[slot] = components[last];
+            sparse[EntityIndex(dense[slot])] = slot;
+        }
+        dense.pop_back();
+        components.pop_back();
+        sparse[EntityIndex(entity)] = EMPTY;
+    }
+
+    // only valid if Has(entity)
+    T &Get(Entity entity) { return components[sparse[EntityIndex(entity)]]; }
+    const T &Get(Entity entity) const { return components[sparse[EntityIndex(entity)]]; }
+
+    unsigned int Size() const { return dense.size(); }
+    // i-th packed component and its owner
+    T &At(unsigned int i) { return components[i]; }
+    Entity EntityAt(unsigned int i) const { return dense[i]; }
+
+private:
+    enum : uint32_t { EMPTY = 0xFFFFFFFFu };
+    std::vector<uint32_t> sparse;
+    std::vector<Entity> dense;
+    std::vector<T> components;
+};
+
+// ids of component types, given out the first time a type is used
+inline unsigned int &ComponentTypeCount()
+{
+    static unsigned int count = 0;
+    return count;
+}
+
+template <typename T>
+unsigned int ComponentType()
+{
+    static const unsigned int type = ComponentTypeCount()++;
+    return type;
+}
+
+class Registry
+{
+public:
+    Entity Create()
+    {
+        unsigned int index;
+        if (!freeSlots.empty())
+        {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            index = generations.size();
+            if (index > 0xFFFFFFu)
+            {
+                std::cout << "ERROR::ECS::TOO_MANY_ENTITIES" << std::endl;
+                return NULL_ENTITY;
+            }
+            generations.push_back(0);
+        }
+        alive++;
+        return index | ((Entity)generations[index] << 24);
+    }
+
+    // removes all components of the entity and frees its slot
+    void Destroy(Entity entity)
+    {
+        if (!Valid(entity))
+            return;
+        for (std::unique_ptr<ComponentPoolBase> &pool : pools)
+            if (pool)
+                pool->Remove(entity);
+        unsigned int index = EntityIndex(entity);
+        generations[index] = (generations[index] + 1) & 0xFF;
+        freeSlots.push_back(index);
+        alive--;
+    }
+
+    bool Valid(Entity entity) const
+    {
+        unsigned int index = EntityIndex(entity);
+        return entity != NULL_ENTITY && index < generations.size() && generations[index] == EntityGeneration(entity);
+    }
+
+    unsigned int Alive() const { return alive; }
+
+    // nullptr if entity is not Valid(), a destroyed entity's handle must not reach whoever got its slot
+    template <typename T>
+    T *Add(Entity entity, const T &component = T())
+    {
+        if (!Valid(entity))
+        {
+            std::cout << "ERROR::ECS::ADD_TO_STALE_ENTITY " << EntityIndex(entity) << std::endl;
+            return nullptr;
+        }
+        return Pool<T>().Add(entity, component);
+    }
+
+    template <typename T>
+    void Remove(Entity entity)
+    {
+        Pool<T>().Remove(entity);
+    }
+
+    template <typename T>
+    bool Has(Entity entity) const
+    {
+        unsigned int type = ComponentType<T>();
+        return type < pools.size() && pools[type] && pools[type]->Has(entity);
+    }
+
+    template <typename T>
+    T &Get(Entity entity)
+    {
+        return Pool<T>().Get(entity);
+    }
+
+    template <typename T>
+    ComponentPool<T> &Pool()
+    {
+        unsigned int type = ComponentType<T>();
+        if (type >= pools.size())
+            pools.resize(type + 1);
+        if (!pools[type])
+            pools[type].reset(new ComponentPool<T>());
+        return static_cast<ComponentPool<T> &>(*pools[type]);
+    }
+
+    // calls function(entity, First &, Rest &...) for every entity that has all of the components.
+    // The First array is walked in order, so it should be the rarest of the types.
+    // No entities or components may be added or removed from inside function.
+    template <typename First, typename... Rest, typename Function>
+    void Each(Function function)
+    {
+        ComponentPool<First> &first = Pool<First>();
+        std::tuple<ComponentPool<Rest> *...> rest(&Pool<Rest>()...);
+        eachRange<First, Rest...>(first, rest, 0, first.Size(), function);
+    }
+
+    // same, split into ranges of grain components that run on the pool's threads. function must only
+    // write to the components it is given
+    template <typename First, typename... Rest, typename Function>
+    void ParallelEach(ThreadPool &threads, Function function, unsigned int grain = 4096)
+    {
+        ComponentPool<First> &first = Pool<First>();
+        std::tuple<ComponentPool<Rest> *...> rest(&Pool<Rest>()...);
+        threads.ParallelFor(first.Size(), [&](unsigned int begin, unsigned int end) {
+            eachRange<First, Rest...>(first, rest, begin, end, function);
+        }, grain);
+    }
+
+private:
+    std::vector<std::unique_ptr<ComponentPoolBase>> pools;
+    std::vector<uint8_t> generations;
+    std::vector<unsigned int> freeSlots;
+    unsigned int alive = 0;
+
+    template <typename... Rest>
+    static bool hasAll(const std::tuple<ComponentPool<Rest> *...> &rest, Entity entity)
+    {
+        bool has[] = {true, std::get<ComponentPool<Rest> *>(rest)->Has(entity)...};
+        for (bool component : has)
+            if (!component)
+                return false;
+        return true;
+    }
+
+    template <typename First, typename... Rest, typename Function>
+    static void eachRange(ComponentPool<First> &first, const std::tuple<ComponentPool<Rest> *...> &rest,
+                          unsigned int begin, unsigned int end, Function &function)
+    {
+        for (unsigned int i = begin; i < end; i++)
+        {
+            Entity entity = first.EntityAt(i);
+            if (!hasAll<Rest...>(rest, entity))
+                continue;
+            function(entity, first.At(i), std::get<ComponentPool<Rest> *>(rest)->Get(entity)...);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,324 @@
+#ifndef FRAME_GRAPH_H
+#define FRAME_GRAPH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/gpu_profiler.h>
+#include <learnopengl/render_targets.h>
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+typedef unsigned int FrameResource;
+
+struct FrameGraphStats {
+    unsigned int passes = 0;
+    unsigned int culledPasses = 0;
+    unsigned int transients = 0;
+    // first writes that cleared the target and those that were left alone because the pass
+    // overwrites every pixel anyway
+    unsigned int clears = 0;
+    unsigned int skippedClears = 0;
+    // framebuffer binds issued and left out because the pass draws where the one before it did
+    unsigned int binds = 0;
+    unsigned int skippedBinds = 0;
+};
+
+// The frame as a list of passes that declare which targets they read and write. It is rebuilt
+// every frame: Reset(), Create() the transient targets, AddPass() in draw order, then Execute().
+//
+// Before running anything the graph walks back from the passes whose output leaves the graph (a
+// write to the window or SideEffect()) and drops every pass whose targets nobody reads. Transient
+// targets are taken from the RenderTargetPool right before the first pass using them and handed
+// back after the last one, so targets with the same descriptor and separate lifetimes share a
+// texture. A target is cleared only on its first write and only if it was created with a clear,
+// and the framebuffer is not rebound when a pass draws into the same targets as the one before.
+class FrameGraph
+{
+    struct Pass;
+
+public:
+    class Builder
+    {
+    public:
+        void Read(FrameResource resource) { pass.reads.push_back(resource); }
+        void Write(FrameResource resource) { pass.writes.push_back(resource); }
+        // the pass does something outside the graph, it is never culled
+        void SideEffect() { pass.sideEffect = true; }
+
+    private:
+        friend class FrameGraph;
+        Pass &pass;
+        explicit Builder(Pass &pass) : pass(pass) {}
+    };
+
+    typedef std::function<void(Builder &)> SetupFunction;
+    typedef std::function<void(const FrameGraph &)> ExecuteFunction;
+
+    FrameGraphStats stats;
+    // when set, every pass that runs is a GPU scope named after it
+    GpuProfiler *profiler = nullptr;
+
+    explicit FrameGraph(RenderTargetPool &pool) : pool(pool) {}
+
+    void Reset()
+    {
+        passes.clear();
+        resources.clear();
+    }
+
+    // target that only lives inside the frame. clear, if set, is what the first pass writing it
+    // finds in it; depth targets are cleared to 1 regardless of the color
+    FrameResource Create(const std::string &name, const RenderTargetDesc &desc, bool clear = false,
+                         const glm::vec4 &clearColor = glm::vec4(0.0f))
+    {
+        Resource resource(name, desc);
+        resource.clear = clear;
+        resource.clearColor = clearColor;
+        resources.push_back(resource);
+        return resources.size() - 1;
+    }
+
+    // the default framebuffer, passes writing to it are what the graph is kept for
+    FrameResource ImportBackbuffer(const std::string &name, unsigned int width, unsigned int height)
+    {
+        Resource resource(name, RenderTargetDesc{width, height, GL_RGBA8});
+        resource.imported = true;
+        resources.push_back(resource);
+        return resources.size() - 1;
+    }
+
+    void AddPass(const std::string &name, const SetupFunction &setup, const ExecuteFunction &execute)
+    {
+        passes.push_back(Pass());
+        Pass &pass = passes.back();
+        pass.name = name;
+        pass.execute = execute;
+        Builder builder(pass);
+        setup(builder);
+    }
+
+    // culls, allocates and runs the passes in the order they were added
+    void Execute()
+    {
+        compile();
+        stats.passes = passes.size();
+        stats.clears = stats.skippedClears = stats.binds = stats.skippedBinds = 0;
+        GLint bound = -1;
+        for (unsigned int i = 0; i < passes.size(); i++)
+        {
+            Pass &pass = passes[i];
+            if (pass.culled)
+                continue;
+            for (FrameResource id : pass.writes)
+            {
+                Resource &resource = resources[id];
+                if (!resource.imported && resource.texture == 0)
+                    resource.texture = pool.Acquire(resource.desc);
+            }
+            for (FrameResource id : pass.reads)
+                if (!resources[id].imported && resources[id].texture == 0)
+                    std::cout << "ERROR::FRAME_GRAPH::READ_BEFORE_WRITE " << resources[id].name << " in " << pass.name << std::endl;
+
+            if (!pass.writes.empty())
+            {
+                currentFramebuffer = framebufferOf(pass);
+                if ((GLint)currentFramebuffer != bound)
+                {
+                    glBindFramebuffer(GL_FRAMEBUFFER, currentFramebuffer);
+                    stats.binds++;
+                }
+                else
+                    stats.skippedBinds++;
+                const RenderTargetDesc &size = resources[pass.writes[0]].desc;
+                glViewport(0, 0, size.width, size.height);
+                clearFirstWrites(pass, i);
+            }
+
+            if (profiler)
+                profiler->Begin(pass.name);
+            pass.execute(*this);
+            if (profiler)
+                profiler->End();
+            // the pass may have drawn somewhere else in between, e.g. into shadow maps
+            glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+
+            for (Resource &resource : resources)
+            {
+                if (!resource.imported && resource.texture != 0 && resource.lastUse == i)
+                {
+                    pool.Release(resource.texture);
+                    resource.texture = 0;
+                }
+            }
+        }
+    }
+
+    // texture of a transient target, only while a pass using it runs
+    unsigned int Texture(FrameResource resource) const { return resources[resource].texture; }
+    const RenderTargetDesc &Desc(FrameResource resource) const { return resources[resource].desc; }
+    // what the running pass draws into
+    unsigned int CurrentFramebuffer() const { return currentFramebuffer; }
+
+private:
+    struct Resource {
+        std::string name;
+        RenderTargetDesc desc;
+        bool imported = false;
+        bool clear = false;
+        glm::vec4 clearColor;
+        unsigned int texture = 0;
+        // readers, and passes with a write left after culling
+        unsigned int refCount = 0;
+        unsigned int firstUse = 0, lastUse = 0;
+
+        Resource(const std::string &name, const RenderTargetDesc &desc) : name(name), desc(desc) {}
+    };
+
+    struct Pass {
+        std::string name;
+        std::vector<FrameResource> reads;
+        std::vector<FrameResource> writes;
+        bool sideEffect = false;
+        bool culled = false;
+        unsigned int refCount = 0;
+        ExecuteFunction execute;
+    };
+
+    RenderTargetPool &pool;
+    std::vector<Pass> passes;
+    std::vector<Resource> resources;
+    unsigned int currentFramebuffer = 0;
+
+    void compile()
+    {
+        for (Resource &resource : resources)
+            resource.refCount = 0;
+        for (Pass &pass : passes)
+        {
+            pass.culled = false;
+            pass.refCount = pass.writes.size();
+            for (FrameResource id : pass.reads)
+                resources[id].refCount++;
+            for (FrameResource id : pass.writes)
+                if (resources[id].imported)
+                    pass.sideEffect = true;
+        }
+
+        // a target nobody reads makes its writers one output poorer, a writer without outputs goes
+        // and takes its reads with it
+        std::vector<FrameResource> unused;
+        for (unsigned int id = 0; id < resources.size(); id++)
+            if (resources[id].refCount == 0 && !resources[id].imported)
+                unused.push_back(id);
+        while (!unused.empty())
+        {
+            FrameResource id = unused.back();
+            unused.pop_back();
+            for (Pass &pass : passes)
+            {
+                if (pass.culled || pass.sideEffect || !writes(pass, id))
+                    continue;
+                if (--pass.refCount > 0)
+                    continue;
+                pass.culled = true;
+                for (FrameResource read : pass.reads)
+                    if (--resources[read].refCount == 0 && !resources[read].imported)
+                        unused.push_back(read);
+            }
+        }
+
+        stats.culledPasses = 0;
+        stats.transients = 0;
+        std::vector<bool> used(resources.size(), false);
+        for (unsigned int i = 0; i < passes.size(); i++)
+        {
+            if (passes[i].culled)
+            {
+                stats.culledPasses++;
+                continue;
+            }
+            for (const std::vector<FrameResource> *list : {&passes[i].reads, &passes[i].writes})
+            {
+                for (FrameResource id : *list)
+                {
+                    if (!used[id])
+                        resources[id].firstUse = i;
+                    used[id] = true;
+                    resources[id].lastUse = i;
+                }
+            }
+        }
+        for (unsigned int id = 0; id < resources.size(); id++)
+            if (used[id] && !resources[id].imported)
+                stats.transients++;
+    }
+
+    static bool writes(const Pass &pass, FrameResource id)
+    {
+        for (FrameResource write : pass.writes)
+            if (write == id)
+                return true;
+        return false;
+    }
+
+    unsigned int framebufferOf(const Pass &pass)
+    {
+        std::vector<unsigned int> colors;
+        unsigned int depthStencil = 0;
+        for (FrameResource id : pass.writes)
+        {
+            const Resource &resource = resources[id];
+            if (resource.imported)
+            {
+                if (pass.writes.size() > 1)
+                    std::cout << "ERROR::FRAME_GRAPH::BACKBUFFER_WITH_OTHER_TARGETS in " << pass.name << std::endl;
+                return 0;
+            }
+            if (RenderTargetPool::IsDepthFormat(resource.desc.internalFormat))
+                depthStencil = resource.texture;
+            else
+                colors.push_back(resource.texture);
+        }
+        return pool.Framebuffer(colors, depthStencil);
+    }
+
+    // one glClear for every target this pass writes first
+    void clearFirstWrites(const Pass &pass, unsigned int index)
+    {
+        GLbitfield mask = 0;
+        for (FrameResource id : pass.writes)
+        {
+            const Resource &resource = resources[id];
+            if (resource.firstUse != index)
+                continue;
+            if (!resource.clear)
+            {
+                stats.skippedClears++;
+                continue;
+            }
+            stats.clears++;
+            if (RenderTargetPool::IsDepthFormat(resource.desc.internalFormat))
+            {
+                mask |= GL_DEPTH_BUFFER_BIT;
+                if (resource.desc.internalFormat == GL_DEPTH24_STENCIL8)
+                    mask |= GL_STENCIL_BUFFER_BIT;
+            }
+            else
+            {
+                glClearColor(resource.clearColor.x, resource.clearColor.y, resource.clearColor.z, resource.clearColor.w);
+                mask |= GL_COLOR_BUFFER_BIT;
+            }
+        }
+        if (mask != 0)
+        {
+            glDepthMask(GL_TRUE);
+            glClear(mask);
+        }
+    }
+};
+
+#endif
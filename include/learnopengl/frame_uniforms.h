@@ -0,0 +1,41 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/uniform_blocks.h>
+#include <learnopengl/upload_ring.h>
+
+// CPU side of the std140 FrameData block, keep in sync with the shaders
+struct FrameData {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::mat4 inverseViewProjection;
+    glm::vec4 cameraPosition;
+    float time;
+    float padding[3];
+};
+
+// Camera constants shared by every program, written once per frame to the upload ring
+// and bound to the FrameData block. Update() is false when the ring had no room for them
+class FrameUniforms
+{
+public:
+    bool Update(UploadRing &ring, const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &cameraPosition, float time)
+    {
+        FrameData data;
+        data.view = view;
+        data.projection = projection;
+        data.viewProjection = projection * view;
+        data.inverseViewProjection = glm::inverse(data.viewProjection);
+        data.cameraPosition = glm::vec4(cameraPosition, 1.0f);
+        data.time = time;
+        data.padding[0] = data.padding[1] = data.padding[2] = 0.0f;
+
+        return ring.BindUniform(UNIFORM_BLOCK_FRAME, &data, sizeof(FrameData));
+    }
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// glad was generated for plain GL 3.3 core. Newer entry points are loaded here at runtime,
+// every feature stays off unless the driver reports its extension, so callers keep a 3.3 path.
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRYP PFNBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+typedef void (APIENTRYP PFNMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void *indirect,
+                                                           GLsizei drawCount, GLsizei stride);
+typedef void (APIENTRYP PFNGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat,
+                                                 void *binary);
+typedef void (APIENTRYP PFNPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFNPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP PFNMAXSHADERCOMPILERTHREADSPROC)(GLuint count);
+
+struct GLExtensions {
+    // ARB_buffer_storage, for persistently mapped buffers
+    bool bufferStorage = false;
+    PFNBUFFERSTORAGEPROC BufferStorage = nullptr;
+    // ARB_multi_draw_indirect, ARB_base_instance is part of it in every driver that has it
+    bool multiDrawIndirect = false;
+    PFNMULTIDRAWELEMENTSINDIRECTPROC MultiDrawElementsIndirect = nullptr;
+    // ARB_get_program_binary, only counted when the driver offers at least one binary format
+    bool programBinary = false;
+    PFNGETPROGRAMBINARYPROC GetProgramBinary = nullptr;
+    PFNPROGRAMBINARYPROC ProgramBinary = nullptr;
+    PFNPROGRAMPARAMETERIPROC ProgramParameteri = nullptr;
+    // KHR_parallel_shader_compile or its ARB twin, compiles and links finish on driver threads and
+    // GL_COMPLETION_STATUS_KHR says when without waiting
+    bool parallelShaderCompile = false;
+    PFNMAXSHADERCOMPILERTHREADSPROC MaxShaderCompilerThreads = nullptr;
+};
+
+inline GLExtensions &GLExt()
+{
+    static GLExtensions extensions;
+    return extensions;
+}
+
+inline bool HasGLExtension(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// call once after gladLoadGLLoader, with the same loader
+inline void LoadGLExtensions(GLADloadproc load)
+{
+    GLExtensions &ext = GLExt();
+    if (HasGLExtension("GL_ARB_buffer_storage"))
+    {
+        ext.BufferStorage = (PFNBUFFERSTORAGEPROC)load("glBufferStorage");
+        ext.bufferStorage = ext.BufferStorage != nullptr;
+    }
+    if (HasGLExtension("GL_ARB_multi_draw_indirect") && HasGLExtension("GL_ARB_base_instance"))
+    {
+        ext.MultiDrawElementsIndirect = (PFNMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+        ext.multiDrawIndirect = ext.MultiDrawElementsIndirect != nullptr;
+    }
+    if (HasGLExtension("GL_ARB_get_program_binary"))
+    {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        ext.GetProgramBinary = (PFNGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+        ext.ProgramBinary = (PFNPROGRAMBINARYPROC)load("glProgramBinary");
+        ext.ProgramParameteri = (PFNPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+        ext.programBinary = formats > 0 && ext.GetProgramBinary && ext.ProgramBinary && ext.ProgramParameteri;
+    }
+    if (HasGLExtension("GL_KHR_parallel_shader_compile"))
+        ext.MaxShaderCompilerThreads = (PFNMAXSHADERCOMPILERTHREADSPROC)load("glMaxShaderCompilerThreadsKHR");
+    else if (HasGLExtension("GL_ARB_parallel_shader_compile"))
+        ext.MaxShaderCompilerThreads = (PFNMAXSHADERCOMPILERTHREADSPROC)load("glMaxShaderCompilerThreadsARB");
+    if (ext.MaxShaderCompilerThreads)
+    {
+        // as many threads as the driver likes
+        ext.MaxShaderCompilerThreads(0xFFFFFFFFu);
+        ext.parallelShaderCompile = true;
+    }
+}
+
+#endif
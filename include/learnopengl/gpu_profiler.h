@@ -0,0 +1,294 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct GpuTimingStats {
+    std::string name;
+    // nesting level the scope was first seen at, 0 is the whole frame
+    unsigned int depth = 0;
+    // frames in the rolling window, of all frames measured
+    unsigned int samples = 0;
+    unsigned int totalSamples = 0;
+    double lastMs = 0.0;
+    double avgMs = 0.0;
+    double p50Ms = 0.0;
+    double p95Ms = 0.0;
+    double p99Ms = 0.0;
+    double maxMs = 0.0;
+};
+
+// GPU time of named, nested scopes of the frame. Every Begin()/End() puts a GL_TIMESTAMP query
+// into the command stream, so scopes nest and can sit inside the GL_TIME_ELAPSED queries other
+// parts of the renderer use. The queries of a frame are read back QUERY_FRAMES frames later, when
+// their slot of the ring comes round again; a frame whose results are still not there is dropped
+// instead of waiting for it.
+//
+// Each scope keeps the last historyFrames frames, a scope entered more than once in a frame counts
+// with the sum. The whole frame is a scope of its own, "frame". Destroy() deletes the queries and
+// has to run before the context is gone.
+class GpuProfiler
+{
+public:
+    static const unsigned int QUERY_FRAMES = 4;
+
+    unsigned int historyFrames = 240;
+    // frames whose queries were not ready when their slot was needed again
+    unsigned int droppedFrames = 0;
+
+    // deletes the queries of every frame, results not read back yet are lost; Stats() stay
+    void Destroy()
+    {
+        for (Frame &frame : frames)
+        {
+            if (!frame.queries.empty())
+                glDeleteQueries(frame.queries.size(), &frame.queries[0]);
+            frame.queries.clear();
+            frame.markers.clear();
+            frame.usedQueries = 0;
+            frame.issued = false;
+        }
+        open.clear();
+    }
+
+    void BeginFrame()
+    {
+        Frame &frame = frames[frameIndex];
+        if (frame.issued)
+            collect(frame);
+        frame.issued = false;
+        frame.markers.clear();
+        frame.usedQueries = 0;
+        open.clear();
+        Begin("frame");
+    }
+
+    void Begin(const std::string &name)
+    {
+        Frame &frame = frames[frameIndex];
+        Marker marker;
+        marker.timer = timerFor(name, open.size());
+        marker.begin = query(frame);
+        marker.end = 0;
+        glQueryCounter(frame.queries[marker.begin], GL_TIMESTAMP);
+        open.push_back(frame.markers.size());
+        frame.markers.push_back(marker);
+    }
+
+    void End()
+    {
+        if (open.empty())
+        {
+            std::cout << "ERROR::GPU_PROFILER::END_WITHOUT_BEGIN" << std::endl;
+            return;
+        }
+        Frame &frame = frames[frameIndex];
+        Marker &marker = frame.markers[open.back()];
+        open.pop_back();
+        marker.end = query(frame);
+        glQueryCounter(frame.queries[marker.end], GL_TIMESTAMP);
+    }
+
+    void EndFrame()
+    {
+        // the frame scope is the only one left open
+        if (open.size() > 1)
+            std::cout << "ERROR::GPU_PROFILER::SCOPE_LEFT_OPEN " << timers[frames[frameIndex].markers[open.back()].timer].name << std::endl;
+        while (!open.empty())
+            End();
+        frames[frameIndex].issued = true;
+        frameIndex = (frameIndex + 1) % QUERY_FRAMES;
+    }
+
+    // rolling statistics of every scope, in the order they were first entered
+    std::vector<GpuTimingStats> Stats() const
+    {
+        std::vector<GpuTimingStats> result;
+        for (const Timer &timer : timers)
+        {
+            GpuTimingStats stats;
+            stats.name = timer.name;
+            stats.depth = timer.depth;
+            stats.samples = timer.history.size();
+            stats.totalSamples = timer.totalSamples;
+            if (!timer.history.empty())
+            {
+                stats.lastMs = timer.lastMs;
+                std::vector<double> sorted = timer.history;
+                std::sort(sorted.begin(), sorted.end());
+                double sum = 0.0;
+                for (double time : sorted)
+                    sum += time;
+                stats.avgMs = sum / sorted.size();
+                stats.p50Ms = sorted[(sorted.size() - 1) * 50 / 100];
+                stats.p95Ms = sorted[(sorted.size() - 1) * 95 / 100];
+                stats.p99Ms = sorted[(sorted.size() - 1) * 99 / 100];
+                stats.maxMs = sorted.back();
+            }
+            result.push_back(stats);
+        }
+        return result;
+    }
+
+    bool WriteCsv(const std::string &path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::GPU_PROFILER::CANNOT_WRITE " << path << std::endl;
+            return false;
+        }
+        file << "scope,depth,samples,total_samples,last_ms,avg_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+        for (const GpuTimingStats &stats : Stats())
+            file << stats.name << "," << stats.depth << "," << stats.samples << "," << stats.totalSamples << ","
+                 << stats.lastMs << "," << stats.avgMs << "," << stats.p50Ms << "," << stats.p95Ms << ","
+                 << stats.p99Ms << "," << stats.maxMs << "\n";
+        return true;
+    }
+
+    // the same as the CSV plus the rolling window of every scope, oldest frame first
+    bool WriteJson(const std::string &path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::GPU_PROFILER::CANNOT_WRITE " << path << std::endl;
+            return false;
+        }
+        std::vector<GpuTimingStats> stats = Stats();
+        file << "{\n  \"dropped_frames\": " << droppedFrames << ",\n  \"scopes\": [";
+        for (unsigned int i = 0; i < stats.size(); i++)
+        {
+            const GpuTimingStats &scope = stats[i];
+            file << (i > 0 ? "," : "") << "\n    {\"name\": \"" << scope.name << "\", \"depth\": " << scope.depth
+                 << ", \"samples\": " << scope.samples << ", \"total_samples\": " << scope.totalSamples
+                 << ", \"last_ms\": " << scope.lastMs << ", \"avg_ms\": " << scope.avgMs << ", \"p50_ms\": " << scope.p50Ms
+                 << ", \"p95_ms\": " << scope.p95Ms << ", \"p99_ms\": " << scope.p99Ms << ", \"max_ms\": " << scope.maxMs
+                 << ", \"history_ms\": [";
+            const Timer &timer = timers[i];
+            for (unsigned int j = 0; j < timer.history.size(); j++)
+                file << (j > 0 ? ", " : "") << timer.history[(timer.next + j) % timer.history.size()];
+            file << "]}";
+        }
+        file << "\n  ]\n}\n";
+        return true;
+    }
+
+private:
+    struct Marker {
+        unsigned int timer;
+        // indices into the frame's queries
+        unsigned int begin, end;
+    };
+
+    struct Frame {
+        std::vector<unsigned int> queries;
+        unsigned int usedQueries = 0;
+        std::vector<Marker> markers;
+        bool issued = false;
+    };
+
+    struct Timer {
+        std::string name;
+        unsigned int depth;
+        // rolling window, next is where the oldest sample is once it is full
+        std::vector<double> history;
+        unsigned int next = 0;
+        unsigned int totalSamples = 0;
+        double lastMs = 0.0;
+    };
+
+    Frame frames[QUERY_FRAMES];
+    unsigned int frameIndex = 0;
+    // markers of the current frame that were begun and not ended yet
+    std::vector<unsigned int> open;
+    std::vector<Timer> timers;
+    std::unordered_map<std::string, unsigned int> timerIndices;
+
+    unsigned int timerFor(const std::string &name, unsigned int depth)
+    {
+        std::unordered_map<std::string, unsigned int>::iterator found = timerIndices.find(name);
+        if (found != timerIndices.end())
+            return found->second;
+        Timer timer;
+        timer.name = name;
+        timer.depth = depth;
+        timers.push_back(timer);
+        timerIndices[name] = timers.size() - 1;
+        return timers.size() - 1;
+    }
+
+    // next free query of the frame, the pool only grows
+    static unsigned int query(Frame &frame)
+    {
+        if (frame.usedQueries == frame.queries.size())
+        {
+            unsigned int id;
+            glGenQueries(1, &id);
+            frame.queries.push_back(id);
+        }
+        return frame.usedQueries++;
+    }
+
+    void collect(const Frame &frame)
+    {
+        if (frame.markers.empty())
+            return;
+        // timestamps complete in order, so the frame's last query being there means all of them are
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            droppedFrames++;
+            return;
+        }
+        std::vector<double> frameMs(timers.size(), -1.0);
+        for (const Marker &marker : frame.markers)
+        {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(frame.queries[marker.begin], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(frame.queries[marker.end], GL_QUERY_RESULT, &end);
+            double ms = end > begin ? (double)(end - begin) / 1000000.0 : 0.0;
+            frameMs[marker.timer] = std::max(frameMs[marker.timer], 0.0) + ms;
+        }
+        for (unsigned int i = 0; i < frameMs.size(); i++)
+            if (frameMs[i] >= 0.0)
+                record(timers[i], frameMs[i]);
+    }
+
+    void record(Timer &timer, double ms)
+    {
+        timer.lastMs = ms;
+        timer.totalSamples++;
+        if (timer.history.size() < historyFrames)
+        {
+            timer.history.push_back(ms);
+            return;
+        }
+        timer.history[timer.next] = ms;
+        timer.next = (timer.next + 1) % timer.history.size();
+    }
+};
+
+// times the enclosing block, e.g. { GpuScope scope(profiler, "shadows"); ... }
+class GpuScope
+{
+public:
+    GpuScope(GpuProfiler &profiler, const std::string &name) : profiler(profiler) { profiler.Begin(name); }
+    ~GpuScope() { profiler.End(); }
+
+    GpuScope(const GpuScope &) = delete;
+    GpuScope &operator=(const GpuScope &) = delete;
+
+private:
+    GpuProfiler &profiler;
+};
+
+#endif
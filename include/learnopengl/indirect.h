@@ -0,0 +1,276 @@
+#ifndef INDIRECT_H
+#define INDIRECT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/bounds.h>
+#include <learnopengl/gl_extensions.h>
+#include <learnopengl/instancing.h>
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+// layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+struct IndirectStats {
+    unsigned int draws = 0;
+    unsigned int commands = 0;
+    unsigned int materialGroups = 0;
+    unsigned int drawCalls = 0;
+};
+
+// Static models merged into one vertex and index buffer, so every submesh can be drawn from a single VAO.
+// Each frame the visible submeshes are collected with Add(), Draw() sorts them by material, turns
+// repeated submeshes into instanced commands and issues one glMultiDrawElementsIndirect per material.
+// The model matrix of a draw is read per instance (light.vs with INSTANCED) from baseInstance onwards.
+// Without ARB_multi_draw_indirect the same commands go out as glDrawElementsInstancedBaseVertex,
+// with the instance attributes re-pointed per command since GL 3.3 has no baseInstance.
+class StaticBatch
+{
+public:
+    IndirectStats stats;
+
+    // copies the meshes of a model into the batch, returns the id to pass to Add(). Call before Build().
+    unsigned int AddModel(const Model &model)
+    {
+        unsigned int id = objects.size();
+        objects.push_back({(unsigned int)parts.size(), (unsigned int)model.meshes.size()});
+        for (const Mesh &mesh : model.meshes)
+        {
+            Part part;
+            part.firstIndex = indices.size();
+            part.count = mesh.indices.size();
+            part.baseVertex = vertices.size();
+            part.material = registerMaterial(mesh.MaterialTextures());
+            part.bounds = mesh.bounds;
+            part.sphere = mesh.sphere;
+            parts.push_back(part);
+            vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+            indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+        }
+        return id;
+    }
+
+    // uploads the merged geometry, the CPU copies are released
+    void Build()
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &indirectBuffer);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.empty() ? NULL : &vertices[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.empty() ? NULL : &indices[0], GL_STATIC_DRAW);
+        // same layout as Mesh
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        glBindVertexArray(0);
+
+        transforms.assign(1, glm::mat4(1.0f));
+        instances.Upload(transforms);
+        instances.Attach(VAO);
+
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+    }
+
+    // starts collecting the draws of a frame
+    void Begin()
+    {
+        for (std::vector<PendingDraw> &pending : pendingDraws)
+            pending.clear();
+    }
+
+    // draws every submesh of the object with the given model matrix
+    void Add(unsigned int object, const glm::mat4 &model)
+    {
+        for (unsigned int part = objects[object].first; part < objects[object].first + objects[object].count; part++)
+            pendingDraws[parts[part].material].push_back({part, model});
+    }
+
+    // same, leaving out submeshes outside the frustum
+    void Add(unsigned int object, const glm::mat4 &model, const Frustum &frustum, CullStats &cullStats)
+    {
+        for (unsigned int part = objects[object].first; part < objects[object].first + objects[object].count; part++)
+        {
+            if (!frustum.Intersects(parts[part].sphere.Transform(model)) || !frustum.Intersects(parts[part].bounds.Transform(model)))
+            {
+                cullStats.culled++;
+                continue;
+            }
+            cullStats.drawn++;
+            pendingDraws[parts[part].material].push_back({part, model});
+        }
+    }
+
+    // the shader has to read its model matrix from the instance attributes
+    void Draw(Shader &shader)
+    {
+        stats = IndirectStats();
+        commands.clear();
+        transforms.clear();
+        groups.clear();
+        for (unsigned int material = 0; material < pendingDraws.size(); material++)
+        {
+            std::vector<PendingDraw> &pending = pendingDraws[material];
+            if (pending.empty())
+                continue;
+            stats.draws += pending.size();
+            // copies of the same submesh become one command
+            std::sort(pending.begin(), pending.end(), [](const PendingDraw &a, const PendingDraw &b) { return a.part < b.part; });
+            Group group = {material, (unsigned int)commands.size(), 0};
+            for (unsigned int i = 0; i < pending.size();)
+            {
+                const Part &part = parts[pending[i].part];
+                DrawElementsIndirectCommand command = {part.count, 0, part.firstIndex, (GLint)part.baseVertex, (GLuint)transforms.size()};
+                for (unsigned int current = pending[i].part; i < pending.size() && pending[i].part == current; i++)
+                {
+                    transforms.push_back(pending[i].model);
+                    command.instanceCount++;
+                }
+                commands.push_back(command);
+            }
+            group.count = commands.size() - group.first;
+            groups.push_back(group);
+        }
+        stats.commands = commands.size();
+        stats.materialGroups = groups.size();
+        if (commands.empty())
+            return;
+
+        instances.Upload(transforms);
+        const GLExtensions &ext = GLExt();
+        if (ext.multiDrawIndirect)
+        {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), &commands[0], GL_STREAM_DRAW);
+        }
+
+        shader.use();
+        glBindVertexArray(VAO);
+        for (const Group &group : groups)
+        {
+            bindMaterial(shader, group.material);
+            if (ext.multiDrawIndirect)
+            {
+                ext.MultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                              (void*)(group.first * sizeof(DrawElementsIndirectCommand)), group.count, 0);
+                stats.drawCalls++;
+                continue;
+            }
+            for (unsigned int i = group.first; i < group.first + group.count; i++)
+            {
+                const DrawElementsIndirectCommand &command = commands[i];
+                instances.Attach(VAO, command.baseInstance);
+                glBindVertexArray(VAO);
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+                                                  (void*)(command.firstIndex * sizeof(unsigned int)),
+                                                  command.instanceCount, command.baseVertex);
+                stats.drawCalls++;
+            }
+        }
+        if (ext.multiDrawIndirect)
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    struct Object {
+        unsigned int first;
+        unsigned int count;
+    };
+    struct Part {
+        GLuint firstIndex;
+        GLuint count;
+        unsigned int baseVertex;
+        unsigned int material;
+        AABB bounds;
+        BoundingSphere sphere;
+    };
+    struct PendingDraw {
+        unsigned int part;
+        glm::mat4 model;
+    };
+    struct Group {
+        unsigned int material;
+        unsigned int first;
+        unsigned int count;
+    };
+
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    unsigned int indirectBuffer = 0;
+    InstanceBuffer instances;
+
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    std::vector<Object> objects;
+    std::vector<Part> parts;
+    std::vector<std::vector<MaterialTexture>> materials;
+    std::map<std::vector<MaterialTexture>, unsigned int> materialIndices;
+    // sampler uniforms per (program << 32 | material)
+    std::unordered_map<uint64_t, std::vector<Shader::Uniform<int>>> samplerUniforms;
+
+    std::vector<std::vector<PendingDraw>> pendingDraws;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<glm::mat4> transforms;
+    std::vector<Group> groups;
+
+    unsigned int registerMaterial(const std::vector<MaterialTexture> &textures)
+    {
+        auto it = materialIndices.find(textures);
+        if (it != materialIndices.end())
+            return it->second;
+        unsigned int index = materials.size();
+        materials.push_back(textures);
+        materialIndices[textures] = index;
+        pendingDraws.resize(materials.size());
+        return index;
+    }
+
+    void bindMaterial(const Shader &shader, unsigned int material)
+    {
+        const std::vector<MaterialTexture> &textures = materials[material];
+        uint64_t key = ((uint64_t)shader.ID << 32) | material;
+        auto it = samplerUniforms.find(key);
+        if (it == samplerUniforms.end())
+        {
+            std::vector<Shader::Uniform<int>> samplers;
+            for (const MaterialTexture &texture : textures)
+                samplers.push_back(shader.uniform<int>(texture.sampler));
+            it = samplerUniforms.insert({key, samplers}).first;
+        }
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            shader.set(it->second[i], (int)i);
+            glBindTexture(textures[i].target, textures[i].id);
+        }
+    }
+};
+
+#endif
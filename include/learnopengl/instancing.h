@@ -0,0 +1,57 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Per-instance model matrices for instanced draws. The matrix takes the four attribute
+// locations after the ones Mesh uses, see light.vs (INSTANCED) and texture_instanced.vs.
+class InstanceBuffer
+{
+public:
+    static const unsigned int MATRIX_LOCATION = 5;
+
+    unsigned int ID = 0;
+
+    InstanceBuffer() {}
+    InstanceBuffer(const InstanceBuffer &) = delete;
+    InstanceBuffer &operator=(const InstanceBuffer &) = delete;
+
+    // replaces the instances, the old storage is orphaned so draws still reading it are not stalled
+    void Upload(const std::vector<glm::mat4> &transforms)
+    {
+        if (ID == 0)
+            glGenBuffers(1, &ID);
+        count = transforms.size();
+        glBindBuffer(GL_ARRAY_BUFFER, ID);
+        // never empty, VAOs keep the attached attributes enabled for their plain draws too
+        glBufferData(GL_ARRAY_BUFFER, (count > 0 ? count : 1) * sizeof(glm::mat4), count > 0 ? &transforms[0] : NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    unsigned int Count() const { return count; }
+
+    // points the instance matrix attributes of VAO at this buffer, they advance once per instance.
+    // firstInstance stands in for baseInstance on GL 3.3.
+    void Attach(unsigned int VAO, unsigned int firstInstance = 0) const
+    {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, ID);
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(MATRIX_LOCATION + column);
+            glVertexAttribPointer(MATRIX_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                  (void*)(firstInstance * sizeof(glm::mat4) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(MATRIX_LOCATION + column, 1);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+private:
+    unsigned int count = 0;
+};
+
+#endif
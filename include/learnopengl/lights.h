@@ -0,0 +1,185 @@
+#ifndef LIGHTS_H
+#define LIGHTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/uniform_blocks.h>
+#include <learnopengl/upload_ring.h>
+
+#include <cmath>
+#include <vector>
+
+struct PointLight{
+    glm::vec3 position;
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+// distance at which the light's attenuation drops below 5/256 of its brightest color channel,
+// used to bound the light for culling. Ambient counts too, the shaders attenuate it like the rest.
+// 0 for a light that is below that already at its center
+inline float PointLightRadius(const PointLight &light)
+{
+    glm::vec3 color = glm::max(glm::max(light.ambient, light.diffuse), light.specular);
+    float brightest = std::fmax(std::fmax(color.x, color.y), color.z);
+    float threshold = light.constant - brightest * (256.0f / 5.0f);
+    if (threshold >= 0.0f)
+        return 0.0f;
+    if (light.quadratic <= 0.0f)
+        return light.linear > 0.0f ? -threshold / light.linear : 1e30f;
+    float discriminant = std::fmax(light.linear * light.linear - 4.0f * light.quadratic * threshold, 0.0f);
+    return (-light.linear + std::sqrt(discriminant)) / (2.0f * light.quadratic);
+}
+
+struct DirLight{
+    glm::vec3 direction;
+
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+};
+
+// std140 layouts of the LightData and PointLightData blocks in light.fs.
+// The attenuation terms ride in the w components so 256 point lights fit in 16KB,
+// the smallest GL_MAX_UNIFORM_BLOCK_SIZE an implementation may have.
+struct GpuDirLight {
+    glm::vec4 direction;
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+};
+
+struct GpuLightData {
+    GpuDirLight dirLight;
+    int pointLightCount;
+    int padding[3];
+};
+
+struct GpuPointLight {
+    glm::vec4 position;  // w = constant
+    glm::vec4 ambient;   // w = linear
+    glm::vec4 diffuse;   // w = quadratic
+    glm::vec4 specular;  // w = PointLightRadius, for the deferred light volumes
+};
+
+// Keeps the scene lights and mirrors them to the GPU. The GPU layout is only rebuilt when a light
+// was changed since the last Upload(); the uniform blocks are copied into the upload ring every frame,
+// the texture buffer is only re-uploaded on changes.
+// The forward path (light.fs) shades the first MAX_POINT_LIGHTS lights from the uniform block,
+// the clustered path reads all of them from a texture buffer.
+class LightManager
+{
+public:
+    static const unsigned int MAX_POINT_LIGHTS = 256;
+    static const unsigned int MAX_CLUSTERED_POINT_LIGHTS = 16384;
+
+    // number of frames in which the lights had changed
+    unsigned int uploads = 0;
+
+    LightManager()
+    {
+        gpuPointLights.resize(MAX_POINT_LIGHTS);
+        // every light is 4 RGBA32F texels laid out like GpuPointLight
+        glGenBuffers(1, &pointLightTBO);
+        glBindBuffer(GL_TEXTURE_BUFFER, pointLightTBO);
+        glBufferData(GL_TEXTURE_BUFFER, MAX_CLUSTERED_POINT_LIGHTS * sizeof(GpuPointLight), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glGenTextures(1, &pointLightTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, pointLightTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, pointLightTBO);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    const DirLight &GetDirLight() const { return dirLight; }
+    void SetDirLight(const DirLight &light)
+    {
+        dirLight = light;
+        dirty = true;
+    }
+
+    // returns the index of the new light, or -1 when all slots are taken
+    int AddPointLight(const PointLight &light)
+    {
+        if (pointLights.size() >= MAX_CLUSTERED_POINT_LIGHTS)
+            return -1;
+        pointLights.push_back(light);
+        dirty = true;
+        return pointLights.size() - 1;
+    }
+    const PointLight &GetPointLight(unsigned int index) const { return pointLights[index]; }
+    void SetPointLight(unsigned int index, const PointLight &light)
+    {
+        pointLights[index] = light;
+        dirty = true;
+    }
+    unsigned int PointLightCount() const { return pointLights.size(); }
+    const std::vector<PointLight> &PointLights() const { return pointLights; }
+    // texture buffer with every point light, for the clustered path
+    unsigned int PointLightTexture() const { return pointLightTexture; }
+    void ClearPointLights()
+    {
+        pointLights.clear();
+        dirty = true;
+    }
+
+    // call once per frame, the ring regions of earlier frames get reused. False when the ring was full,
+    // the light blocks are not bound then
+    bool Upload(UploadRing &ring)
+    {
+        if (dirty)
+        {
+            dirty = false;
+            uploads++;
+
+            lightData.dirLight.direction = glm::vec4(dirLight.direction, 0.0f);
+            lightData.dirLight.ambient = glm::vec4(dirLight.ambient, 0.0f);
+            lightData.dirLight.diffuse = glm::vec4(dirLight.diffuse, 0.0f);
+            lightData.dirLight.specular = glm::vec4(dirLight.specular, 0.0f);
+            lightData.pointLightCount = pointLights.size() < MAX_POINT_LIGHTS ? pointLights.size() : MAX_POINT_LIGHTS;
+            lightData.padding[0] = lightData.padding[1] = lightData.padding[2] = 0;
+
+            // the uniform block always spans MAX_POINT_LIGHTS entries, the rest is never read
+            gpuPointLights.resize(pointLights.size() > MAX_POINT_LIGHTS ? pointLights.size() : MAX_POINT_LIGHTS);
+            for (unsigned int i = 0; i < pointLights.size(); i++)
+            {
+                const PointLight &light = pointLights[i];
+                gpuPointLights[i].position = glm::vec4(light.position, light.constant);
+                gpuPointLights[i].ambient = glm::vec4(light.ambient, light.linear);
+                gpuPointLights[i].diffuse = glm::vec4(light.diffuse, light.quadratic);
+                gpuPointLights[i].specular = glm::vec4(light.specular, PointLightRadius(light));
+            }
+            if (!pointLights.empty())
+            {
+                glBindBuffer(GL_TEXTURE_BUFFER, pointLightTBO);
+                glBufferSubData(GL_TEXTURE_BUFFER, 0, pointLights.size() * sizeof(GpuPointLight), &gpuPointLights[0]);
+                glBindBuffer(GL_TEXTURE_BUFFER, 0);
+            }
+        }
+
+        GLintptr lightOffset, pointLightOffset;
+        if (!ring.WriteUniform(&lightData, sizeof(GpuLightData), lightOffset) ||
+            !ring.WriteUniform(&gpuPointLights[0], MAX_POINT_LIGHTS * sizeof(GpuPointLight), pointLightOffset))
+            return false;
+        ring.Flush();
+        glBindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_LIGHTS, ring.ID, lightOffset, sizeof(GpuLightData));
+        glBindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_POINT_LIGHTS, ring.ID, pointLightOffset,
+                          MAX_POINT_LIGHTS * sizeof(GpuPointLight));
+        return true;
+    }
+
+private:
+    unsigned int pointLightTBO, pointLightTexture;
+    DirLight dirLight = {};
+    std::vector<PointLight> pointLights;
+    GpuLightData lightData = {};
+    std::vector<GpuPointLight> gpuPointLights;
+    bool dirty = true;
+};
+
+#endif
@@ -7,6 +7,10 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <learnopengl/shader_permutations.h>
+#include <learnopengl/render_queue.h>
+#include <learnopengl/bounds.h>
+#include <learnopengl/instancing.h>
 
 #include <string>
 #include <vector>
@@ -42,6 +46,11 @@ public:
 
     unsigned int VAO;
     std::string glslIdentifierPrefix;
+    // index of this mesh's texture set in the render queue, -1 until first submitted
+    int materialId = -1;
+    // object space bounds, filled in by whoever builds the mesh
+    AABB bounds;
+    BoundingSphere sphere;
     // constructor
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
     {
@@ -56,14 +65,121 @@ public:
     // render the mesh
     void Draw(Shader &shader)
     {
-        // bind appropriate textures
+        bindTextures(shader);
+
+        // draw mesh
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // draws one copy of the mesh per instance, the shader reads its model matrix from the instance attributes
+    void DrawInstanced(Shader &shader, const InstanceBuffer &instances)
+    {
+        if (instances.Count() == 0)
+            return;
+        bindTextures(shader);
+        AttachInstances(instances);
+
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, instances.Count());
+        glBindVertexArray(0);
+
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // queue the mesh for drawing instead of drawing it right away
+    void Submit(RenderQueue &queue, Shader &shader, const glm::mat4 &model, RenderPass pass = RENDER_PASS_OPAQUE)
+    {
+        if (materialId < 0)
+            materialId = queue.RegisterMaterial(MaterialTextures());
+        queue.SubmitIndexed(pass, shader, materialId, VAO, indices.size(), model);
+    }
+
+    // queue the mesh unless its bounds are outside the frustum
+    void Submit(RenderQueue &queue, Shader &shader, const glm::mat4 &model, const Frustum &frustum, CullStats &stats,
+                RenderPass pass = RENDER_PASS_OPAQUE)
+    {
+        // the sphere test is cheaper and rejects most, the box is tighter for long thin meshes
+        if (!frustum.Intersects(sphere.Transform(model)) || !frustum.Intersects(bounds.Transform(model)))
+        {
+            stats.culled++;
+            return;
+        }
+        stats.drawn++;
+        Submit(queue, shader, model, pass);
+    }
+
+    // same, with the matrices of a TransformSystem entry
+    void Submit(RenderQueue &queue, Shader &shader, const TransformSystem &transforms, unsigned int transform,
+                const Frustum &frustum, CullStats &stats, RenderPass pass = RENDER_PASS_OPAQUE)
+    {
+        const glm::mat4 &model = transforms.World(transform);
+        if (!frustum.Intersects(sphere.Transform(model)) || !frustum.Intersects(bounds.Transform(model)))
+        {
+            stats.culled++;
+            return;
+        }
+        stats.drawn++;
+        if (materialId < 0)
+            materialId = queue.RegisterMaterial(MaterialTextures());
+        queue.SubmitIndexed(pass, shader, materialId, VAO, indices.size(), transforms, transform);
+    }
+
+    // queue one instanced draw of the mesh
+    void SubmitInstanced(RenderQueue &queue, Shader &shader, const InstanceBuffer &instances, RenderPass pass = RENDER_PASS_OPAQUE)
+    {
+        if (instances.Count() == 0)
+            return;
+        if (materialId < 0)
+            materialId = queue.RegisterMaterial(MaterialTextures());
+        AttachInstances(instances);
+        queue.SubmitIndexedInstanced(pass, shader, materialId, VAO, indices.size(), instances.Count());
+    }
+
+    // makes the VAO read its instance matrices from the buffer, only touches the VAO when the buffer changes
+    void AttachInstances(const InstanceBuffer &instances)
+    {
+        if (attachedInstances == instances.ID)
+            return;
+        instances.Attach(VAO);
+        attachedInstances = instances.ID;
+    }
+
+    // the shader features the mesh's textures need, the smallest variant that draws it right
+    unsigned int Features() const
+    {
+        unsigned int features = 0;
+        for (const Texture &texture : textures)
+        {
+            if (texture.type == "texture_specular")
+                features |= SHADER_FEATURE_SPECULAR_MAP;
+            else if (texture.type == "texture_normal")
+                features |= SHADER_FEATURE_NORMAL_MAP;
+        }
+        return features;
+    }
+
+    // forget resolved sampler uniforms, needed when the sampler names change
+    void ResetSamplerUniforms()
+    {
+        samplerProgram = 0;
+        samplerUniforms.clear();
+    }
+
+    // textures of the mesh with the sampler each one is bound to, texture i goes to unit i
+    vector<MaterialTexture> MaterialTextures() const
+    {
+        vector<MaterialTexture> samplers;
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -75,27 +191,40 @@ public:
                 number = std::to_string(normalNr++); // transfer unsigned int to stream
             else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            samplers.push_back({GL_TEXTURE_2D, textures[i].id, glslIdentifierPrefix + name + number});
         }
-
-
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        return samplers;
     }
 
 private:
     // render data
     unsigned int VBO, EBO;
+    // sampler uniforms of the program the mesh was last drawn with
+    unsigned int samplerProgram = 0;
+    vector<Shader::Uniform<int>> samplerUniforms;
+    // instance buffer the VAO's instance attributes point at
+    unsigned int attachedInstances = 0;
+
+    void bindTextures(Shader &shader)
+    {
+        // sampler names only have to be resolved again when the mesh is drawn with a different program
+        if (samplerProgram != shader.ID)
+        {
+            samplerProgram = shader.ID;
+            samplerUniforms.clear();
+            for (const MaterialTexture &sampler : MaterialTextures())
+                samplerUniforms.push_back(shader.uniform<int>(sampler.sampler));
+        }
+        // bind appropriate textures
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
+            // now set the sampler to the correct texture unit
+            shader.set(samplerUniforms[i], (int)i);
+            // and finally bind the texture
+            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        }
+    }
 
     // initializes all the buffer objects/arrays
     void setupMesh()
@@ -12,6 +12,7 @@
 
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/render_queue.h>
 
 #include <string>
 #include <fstream>
@@ -19,10 +20,20 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <algorithm>
+#include <cmath>
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// one aiNode of the model, in depth order so parent < own index. The node's transform in the file is
+// not kept, meshes are drawn in the space assimp stores their vertices in, see Model::AddNodes
+struct ModelNode {
+    string name;
+    int parent;
+    // indices into Model::meshes
+    vector<unsigned int> meshes;
+};
 
 
 class Model
@@ -31,8 +42,13 @@ public:
     // model data
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
+    // the aiNode hierarchy, nodes[0] is the root
+    vector<ModelNode> nodes;
     string directory;
     bool gammaCorrection;
+    // object space bounds of all meshes, as they are drawn: without node transforms
+    AABB bounds;
+    BoundingSphere sphere;
 
     // constructor, expects a filepath to a 3D model.
     Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
@@ -47,12 +63,116 @@ public:
             meshes[i].Draw(shader);
     }
 
+    // draws every mesh once per instance in the buffer
+    void DrawInstanced(Shader &shader, const InstanceBuffer &instances)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawInstanced(shader, instances);
+    }
+
+    // draws the model once per transform, the transforms go through the model's own instance buffer
+    void DrawInstanced(Shader &shader, const vector<glm::mat4> &transforms)
+    {
+        instanceBuffer.Upload(transforms);
+        DrawInstanced(shader, instanceBuffer);
+    }
+
+    // queues all meshes of the model, they are drawn when the queue is executed
+    void Submit(RenderQueue &queue, Shader &shader, const glm::mat4 &model, RenderPass pass = RENDER_PASS_OPAQUE)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].Submit(queue, shader, model, pass);
+    }
+
+    // queues the meshes that are inside the frustum, the whole model is rejected first if it can be
+    void Submit(RenderQueue &queue, Shader &shader, const glm::mat4 &model, const Frustum &frustum, CullStats &stats,
+                RenderPass pass = RENDER_PASS_OPAQUE)
+    {
+        if (!frustum.Intersects(sphere.Transform(model)))
+        {
+            stats.culled += meshes.size();
+            return;
+        }
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].Submit(queue, shader, model, frustum, stats, pass);
+    }
+
+    // adds the node hierarchy to the scene graph below parent and returns the root entry, which places
+    // the whole model. The entries only carry the parent links and which meshes belong to a node; they
+    // start at identity because Draw(), the shadow pass, the occluder, the static batch and the bounds
+    // all draw the meshes without node transforms. Moving a node's entry moves its meshes and its
+    // children with it, around the model origin
+    unsigned int AddNodes(TransformSystem &transforms, int parent = -1) const
+    {
+        unsigned int root = transforms.Create(glm::vec3(0.0f), parent);
+        for(unsigned int i = 1; i < nodes.size(); i++)
+            transforms.Create(glm::vec3(0.0f), root + nodes[i].parent);
+        return root;
+    }
+
+    // same, with the matrices of the entries AddNodes created, each mesh is drawn with its node's
+    void Submit(RenderQueue &queue, Shader &shader, const TransformSystem &transforms, unsigned int root,
+                const Frustum &frustum, CullStats &stats, RenderPass pass = RENDER_PASS_OPAQUE)
+    {
+        if (!frustum.Intersects(sphere.Transform(transforms.World(root))))
+        {
+            stats.culled += meshes.size();
+            return;
+        }
+        for(unsigned int i = 0; i < nodes.size(); i++)
+            for(unsigned int mesh : nodes[i].meshes)
+                meshes[mesh].Submit(queue, shader, transforms, root + i, frustum, stats, pass);
+    }
+
+    // same, each mesh with the variant its textures need
+    void Submit(RenderQueue &queue, ShaderPermutations &shaders, const TransformSystem &transforms, unsigned int root,
+                const Frustum &frustum, CullStats &stats, RenderPass pass = RENDER_PASS_OPAQUE)
+    {
+        if (!frustum.Intersects(sphere.Transform(transforms.World(root))))
+        {
+            stats.culled += meshes.size();
+            return;
+        }
+        for(unsigned int i = 0; i < nodes.size(); i++)
+            for(unsigned int mesh : nodes[i].meshes)
+                meshes[mesh].Submit(queue, shaders.Get(meshes[mesh].Features()), transforms, root + i, frustum, stats, pass);
+    }
+
+    // asks for every variant the Submit() and SubmitInstanced() above pick, so they exist before the first frame
+    void RequestShaders(ShaderPermutations &shaders) const
+    {
+        for(const Mesh &mesh : meshes)
+        {
+            shaders.Get(mesh.Features());
+            shaders.Get(mesh.Features() | SHADER_FEATURE_INSTANCED);
+        }
+    }
+
+    // queues one instanced draw per mesh
+    void SubmitInstanced(RenderQueue &queue, Shader &shader, const InstanceBuffer &instances, RenderPass pass = RENDER_PASS_OPAQUE)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].SubmitInstanced(queue, shader, instances, pass);
+    }
+
+    void SubmitInstanced(RenderQueue &queue, ShaderPermutations &shaders, const InstanceBuffer &instances,
+                         RenderPass pass = RENDER_PASS_OPAQUE)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].SubmitInstanced(queue, shaders.Get(meshes[i].Features() | SHADER_FEATURE_INSTANCED), instances, pass);
+    }
+
     void SetShaderTextureNamePrefix(std::string prefix) {
         for (Mesh& mesh: meshes) {
             mesh.glslIdentifierPrefix = prefix;
+            mesh.materialId = -1;
+            mesh.ResetSamplerUniforms();
         }
     }
 private:
+    // used by DrawInstanced with a list of transforms
+    InstanceBuffer instanceBuffer;
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
@@ -69,24 +189,36 @@ private:
         directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        processNode(scene->mRootNode, scene, -1);
+
+        if (bounds.Valid())
+            sphere = BoundingSphere(bounds.Center(), glm::length(bounds.Extents()));
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    // The node is kept in nodes
+    void processNode(aiNode *node, const aiScene *scene, int parent)
     {
+        ModelNode modelNode;
+        modelNode.name = node->mName.C_Str();
+        modelNode.parent = parent;
+
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+            modelNode.meshes.push_back(meshes.size());
             meshes.push_back(processMesh(mesh, scene));
+            bounds.Grow(meshes.back().bounds);
         }
+        int index = nodes.size();
+        nodes.push_back(modelNode);
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, index);
         }
 
     }
@@ -97,6 +229,7 @@ private:
         vector<Vertex> vertices;
         vector<unsigned int> indices;
         vector<Texture> textures;
+        AABB bounds;
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -108,6 +241,7 @@ private:
             vector.y = mesh->mVertices[i].y;
             vector.z = mesh->mVertices[i].z;
             vertex.Position = vector;
+            bounds.Grow(vector);
             // normals
             if (mesh->HasNormals())
             {
@@ -179,7 +313,17 @@ private:
 
 
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        Mesh result(vertices, indices, textures);
+        result.bounds = bounds;
+        // sphere around the box center, through the vertex furthest from it
+        float radius2 = 0.0f;
+        for (const Vertex &v : vertices)
+        {
+            glm::vec3 offset = v.Position - bounds.Center();
+            radius2 = std::max(radius2, glm::dot(offset, offset));
+        }
+        result.sphere = BoundingSphere(bounds.Center(), std::sqrt(radius2));
+        return result;
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -0,0 +1,371 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/bounds.h>
+#include <learnopengl/model.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_SSE 1
+#endif
+
+struct OcclusionStats {
+    unsigned int occluderTriangles = 0;
+    unsigned int tested = 0;
+    unsigned int occluded = 0;
+    double rasterMs = 0.0;
+};
+
+// Software occlusion culling. Designated occluders are rasterized on the CPU into a small depth
+// buffer that holds 1/w per pixel (linear in screen space, larger is closer), split into tiles that
+// are filled in parallel. Each tile also keeps the farthest depth of every 8x8 block, so most
+// bounds tests are decided from the blocks before any pixel is read.
+//
+// Everything errs towards visible: triangles crossing the near plane are not rasterized and
+// bounds that reach behind the camera always pass.
+class OcclusionCuller
+{
+public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 192;
+    static const int TILE_SIZE = 32;
+    static const int TILES_X = WIDTH / TILE_SIZE;
+    static const int TILES_Y = HEIGHT / TILE_SIZE;
+    static const int BLOCK_SIZE = 8;
+    static const int BLOCKS_X = WIDTH / BLOCK_SIZE;
+    static const int BLOCKS_Y = HEIGHT / BLOCK_SIZE;
+
+    OcclusionStats stats;
+
+    OcclusionCuller()
+        : depth(WIDTH * HEIGHT, 0.0f), blockDepth(BLOCKS_X * BLOCKS_Y, 0.0f), bins(TILES_X * TILES_Y)
+    {
+    }
+
+    // registers every mesh of the model as one occluder, returns the id to pass to Draw()
+    unsigned int AddOccluder(const Model &model)
+    {
+        Occluder occluder;
+        for (const Mesh &mesh : model.meshes)
+        {
+            unsigned int base = occluder.positions.size();
+            for (const Vertex &vertex : mesh.vertices)
+                occluder.positions.push_back(vertex.Position);
+            for (unsigned int index : mesh.indices)
+                occluder.indices.push_back(base + index);
+        }
+        return addOccluder(occluder);
+    }
+
+    // non-indexed triangles, e.g. a vertex array with the position at the start of every stride floats
+    unsigned int AddOccluder(const float *vertices, unsigned int vertexCount, unsigned int stride)
+    {
+        Occluder occluder;
+        for (unsigned int i = 0; i < vertexCount; i++)
+        {
+            occluder.positions.push_back(glm::vec3(vertices[i * stride], vertices[i * stride + 1], vertices[i * stride + 2]));
+            occluder.indices.push_back(i);
+        }
+        return addOccluder(occluder);
+    }
+
+    // starts a frame, occluders drawn until Finish() make up the depth buffer.
+    // nearPlane has to match the projection, geometry in front of it is never drawn so it cannot occlude.
+    void Begin(const glm::mat4 &viewProjection, float nearPlane)
+    {
+        this->viewProjection = viewProjection;
+        this->nearPlane = nearPlane;
+        stats = OcclusionStats();
+        triangles.clear();
+        for (std::vector<unsigned int> &bin : bins)
+            bin.clear();
+        start = std::chrono::high_resolution_clock::now();
+    }
+
+    // transforms the occluder and sorts its triangles into the tiles they touch
+    void Draw(unsigned int occluder, const glm::mat4 &model, const Frustum &frustum)
+    {
+        const Occluder &source = occluders[occluder];
+        if (!frustum.Intersects(source.bounds.Transform(model)))
+            return;
+        glm::mat4 transform = viewProjection * model;
+        clip.resize(source.positions.size());
+        for (unsigned int i = 0; i < source.positions.size(); i++)
+            clip[i] = transform * glm::vec4(source.positions[i], 1.0f);
+
+        for (unsigned int i = 0; i + 2 < source.indices.size(); i += 3)
+        {
+            const glm::vec4 &a = clip[source.indices[i]];
+            const glm::vec4 &b = clip[source.indices[i + 1]];
+            const glm::vec4 &c = clip[source.indices[i + 2]];
+            if (a.w < nearPlane || b.w < nearPlane || c.w < nearPlane)
+                continue;
+            ScreenTriangle triangle;
+            toScreen(a, triangle.x[0], triangle.y[0], triangle.z[0]);
+            toScreen(b, triangle.x[1], triangle.y[1], triangle.z[1]);
+            toScreen(c, triangle.x[2], triangle.y[2], triangle.z[2]);
+            float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0])
+                       - (triangle.y[1] - triangle.y[0]) * (triangle.x[2] - triangle.x[0]);
+            // both faces are kept, they only have to wind the same way for the edge functions
+            if (std::fabs(area) < 1e-6f)
+                continue;
+            if (area < 0.0f)
+            {
+                std::swap(triangle.x[1], triangle.x[2]);
+                std::swap(triangle.y[1], triangle.y[2]);
+                std::swap(triangle.z[1], triangle.z[2]);
+            }
+
+            float minX = std::fmin(triangle.x[0], std::fmin(triangle.x[1], triangle.x[2]));
+            float maxX = std::fmax(triangle.x[0], std::fmax(triangle.x[1], triangle.x[2]));
+            float minY = std::fmin(triangle.y[0], std::fmin(triangle.y[1], triangle.y[2]));
+            float maxY = std::fmax(triangle.y[0], std::fmax(triangle.y[1], triangle.y[2]));
+            if (maxX < 0.0f || maxY < 0.0f || minX >= (float)WIDTH || minY >= (float)HEIGHT)
+                continue;
+            int firstTileX = std::max(0, (int)minX / TILE_SIZE);
+            int lastTileX = std::min(TILES_X - 1, (int)maxX / TILE_SIZE);
+            int firstTileY = std::max(0, (int)minY / TILE_SIZE);
+            int lastTileY = std::min(TILES_Y - 1, (int)maxY / TILE_SIZE);
+
+            unsigned int index = triangles.size();
+            triangles.push_back(triangle);
+            for (int tileY = firstTileY; tileY <= lastTileY; tileY++)
+                for (int tileX = firstTileX; tileX <= lastTileX; tileX++)
+                    bins[tileY * TILES_X + tileX].push_back(index);
+        }
+        stats.occluderTriangles = triangles.size();
+    }
+
+    // rasterizes the binned triangles, one tile per job
+    void Finish(ThreadPool &pool)
+    {
+        pool.ParallelFor(TILES_X * TILES_Y, [this](unsigned int begin, unsigned int end) {
+            for (unsigned int tile = begin; tile < end; tile++)
+                rasterizeTile(tile);
+        });
+        stats.rasterMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // false when the box is certainly hidden behind the occluders drawn this frame
+    bool IsVisible(const AABB &box)
+    {
+        stats.tested++;
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+        float nearest = 0.0f;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 point((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y,
+                            (corner & 4) ? box.max.z : box.min.z);
+            glm::vec4 projected = viewProjection * glm::vec4(point, 1.0f);
+            if (projected.w < nearPlane)
+                return true;
+            float x, y, z;
+            toScreen(projected, x, y, z);
+            minX = std::fmin(minX, x);
+            maxX = std::fmax(maxX, x);
+            minY = std::fmin(minY, y);
+            maxY = std::fmax(maxY, y);
+            nearest = std::fmax(nearest, z);
+        }
+        int x0 = std::max(0, (int)std::floor(minX));
+        int x1 = std::min(WIDTH - 1, (int)std::floor(maxX));
+        int y0 = std::max(0, (int)std::floor(minY));
+        int y1 = std::min(HEIGHT - 1, (int)std::floor(maxY));
+        // off screen, left to frustum culling
+        if (x0 > x1 || y0 > y1)
+            return true;
+
+        // coarse: every covered block is entirely in front of the box's nearest point
+        bool hidden = true;
+        for (int blockY = y0 / BLOCK_SIZE; blockY <= y1 / BLOCK_SIZE && hidden; blockY++)
+            for (int blockX = x0 / BLOCK_SIZE; blockX <= x1 / BLOCK_SIZE && hidden; blockX++)
+                hidden = blockDepth[blockY * BLOCKS_X + blockX] > nearest;
+        if (!hidden)
+            hidden = pixelsInFront(x0, y0, x1, y1, nearest);
+        if (hidden)
+            stats.occluded++;
+        return !hidden;
+    }
+
+    const std::vector<float> &Depth() const { return depth; }
+
+    // copies the depth buffer into a GL_R32F texture for the debug view, the texture is created on first use
+    unsigned int UploadDebugTexture()
+    {
+        if (debugTexture == 0)
+        {
+            glGenTextures(1, &debugTexture);
+            glBindTexture(GL_TEXTURE_2D, debugTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, WIDTH, HEIGHT, 0, GL_RED, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, debugTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WIDTH, HEIGHT, GL_RED, GL_FLOAT, &depth[0]);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return debugTexture;
+    }
+
+private:
+    struct Occluder {
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> indices;
+        AABB bounds;
+    };
+    // pixel coordinates with y up, z is 1/w
+    struct ScreenTriangle {
+        float x[3], y[3], z[3];
+    };
+
+    std::vector<Occluder> occluders;
+    std::vector<float> depth;
+    std::vector<float> blockDepth;
+    std::vector<std::vector<unsigned int>> bins;
+    std::vector<ScreenTriangle> triangles;
+    std::vector<glm::vec4> clip;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    // clip space w is the view depth, below this a vertex is in front of the near plane
+    float nearPlane = 0.1f;
+    std::chrono::high_resolution_clock::time_point start;
+    unsigned int debugTexture = 0;
+
+    unsigned int addOccluder(Occluder &occluder)
+    {
+        for (const glm::vec3 &position : occluder.positions)
+            occluder.bounds.Grow(position);
+        occluders.push_back(occluder);
+        return occluders.size() - 1;
+    }
+
+    static void toScreen(const glm::vec4 &clip, float &x, float &y, float &z)
+    {
+        z = 1.0f / clip.w;
+        x = (clip.x * z * 0.5f + 0.5f) * (float)WIDTH;
+        y = (clip.y * z * 0.5f + 0.5f) * (float)HEIGHT;
+    }
+
+    void rasterizeTile(unsigned int tile)
+    {
+        int tileX = (tile % TILES_X) * TILE_SIZE;
+        int tileY = (tile / TILES_X) * TILE_SIZE;
+        for (int y = tileY; y < tileY + TILE_SIZE; y++)
+            std::fill(depth.begin() + y * WIDTH + tileX, depth.begin() + y * WIDTH + tileX + TILE_SIZE, 0.0f);
+
+        for (unsigned int index : bins[tile])
+            rasterizeTriangle(triangles[index], tileX, tileY);
+
+        // farthest depth of every block, the coarse level IsVisible() starts with
+        for (int blockY = tileY / BLOCK_SIZE; blockY < (tileY + TILE_SIZE) / BLOCK_SIZE; blockY++)
+            for (int blockX = tileX / BLOCK_SIZE; blockX < (tileX + TILE_SIZE) / BLOCK_SIZE; blockX++)
+            {
+                float farthest = FLT_MAX;
+                for (int y = blockY * BLOCK_SIZE; y < (blockY + 1) * BLOCK_SIZE; y++)
+                    for (int x = blockX * BLOCK_SIZE; x < (blockX + 1) * BLOCK_SIZE; x++)
+                        farthest = std::fmin(farthest, depth[y * WIDTH + x]);
+                blockDepth[blockY * BLOCKS_X + blockX] = farthest;
+            }
+    }
+
+    // edge functions are positive inside, pixels are sampled at their centers. Pixels exactly on an edge
+    // belong to both triangles, which only writes the same depth twice, so no fill rule is needed.
+    void rasterizeTriangle(const ScreenTriangle &t, int tileX, int tileY)
+    {
+        float minX = std::fmin(t.x[0], std::fmin(t.x[1], t.x[2]));
+        float maxX = std::fmax(t.x[0], std::fmax(t.x[1], t.x[2]));
+        float minY = std::fmin(t.y[0], std::fmin(t.y[1], t.y[2]));
+        float maxY = std::fmax(t.y[0], std::fmax(t.y[1], t.y[2]));
+        // the SIMD loop steps through 4 pixels, so x starts on a multiple of 4
+        int x0 = std::max(tileX, (int)std::floor(minX)) & ~3;
+        int x1 = std::min(tileX + TILE_SIZE - 1, (int)std::floor(maxX));
+        int y0 = std::max(tileY, (int)std::floor(minY));
+        int y1 = std::min(tileY + TILE_SIZE - 1, (int)std::floor(maxY));
+        if (x0 > x1 || y0 > y1)
+            return;
+
+        // E_i(x, y) = a_i * x + b_i * y + c_i for the edge opposite vertex i
+        float a[3], b[3], c[3];
+        for (int i = 0; i < 3; i++)
+        {
+            int j = (i + 1) % 3, k = (i + 2) % 3;
+            a[i] = t.y[j] - t.y[k];
+            b[i] = t.x[k] - t.x[j];
+            c[i] = t.x[j] * t.y[k] - t.x[k] * t.y[j];
+        }
+        float area = c[0] + c[1] + c[2];
+        // 1/w interpolates linearly in screen space: z = za * x + zb * y + zc
+        float za = (a[0] * t.z[0] + a[1] * t.z[1] + a[2] * t.z[2]) / area;
+        float zb = (b[0] * t.z[0] + b[1] * t.z[1] + b[2] * t.z[2]) / area;
+        float zc = (c[0] * t.z[0] + c[1] * t.z[1] + c[2] * t.z[2]) / area;
+
+#ifdef OCCLUSION_SSE
+        __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        __m128 zero = _mm_setzero_ps();
+        for (int y = y0; y <= y1; y++)
+        {
+            float py = (float)y + 0.5f;
+            float *row = &depth[y * WIDTH];
+            for (int x = x0; x <= x1; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[0]), px), _mm_set1_ps(b[0] * py + c[0]));
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[1]), px), _mm_set1_ps(b[1] * py + c[1]));
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[2]), px), _mm_set1_ps(b[2] * py + c[2]));
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+                __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(za), px), _mm_set1_ps(zb * py + zc));
+                __m128 current = _mm_loadu_ps(row + x);
+                __m128 closer = _mm_max_ps(current, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, current)));
+            }
+        }
+#else
+        for (int y = y0; y <= y1; y++)
+        {
+            float py = (float)y + 0.5f;
+            for (int x = x0; x <= x1; x++)
+            {
+                float px = (float)x + 0.5f;
+                if (a[0] * px + b[0] * py + c[0] < 0.0f || a[1] * px + b[1] * py + c[1] < 0.0f ||
+                    a[2] * px + b[2] * py + c[2] < 0.0f)
+                    continue;
+                float &pixel = depth[y * WIDTH + x];
+                pixel = std::fmax(pixel, za * px + zb * py + zc);
+            }
+        }
+#endif
+    }
+
+    // fine level: true when no pixel of the rectangle is at or behind the box's nearest depth
+    bool pixelsInFront(int x0, int y0, int x1, int y1, float nearest) const
+    {
+        for (int y = y0; y <= y1; y++)
+        {
+            const float *row = &depth[y * WIDTH];
+            int x = x0;
+#ifdef OCCLUSION_SSE
+            __m128 limit = _mm_set1_ps(nearest);
+            for (; x + 3 <= x1; x += 4)
+                if (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(row + x), limit)) != 0)
+                    return false;
+#endif
+            for (; x <= x1; x++)
+                if (row[x] <= nearest)
+                    return false;
+        }
+        return true;
+    }
+};
+
+#endif
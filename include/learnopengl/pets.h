@@ -0,0 +1,166 @@
+#ifndef PETS_H
+#define PETS_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/bounds.h>
+#include <learnopengl/ecs.h>
+#include <learnopengl/model.h>
+#include <learnopengl/thread_pool.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// placement of a pet or prop, world is rebuilt whenever it moves
+struct PetTransform {
+    glm::vec3 position;
+    // rotation around +y in radians, 0 faces +z
+    float heading;
+    float scale;
+    glm::mat4 world;
+};
+
+// behaviour of a pet that strolls around its home, turning to a new random heading now and then
+struct Wander {
+    glm::vec3 home;
+    float radius;
+    float speed;
+    float targetHeading;
+    float turnTimer;
+    uint32_t seed;
+};
+
+// the model is drawn instanced with the transform's world matrix, the sphere is its object space
+// bounds kept next to the transform so culling does not follow the pointer
+struct Renderable {
+    const Model *model;
+    BoundingSphere sphere;
+};
+
+struct PetStats {
+    unsigned int pets = 0;
+    unsigned int props = 0;
+    double updateMs = 0.0;
+};
+
+// The pets and props of the world as entities. Update() runs the behaviours on the worker threads,
+// Collect() hands the visible world matrices of one model to the instanced draws.
+class PetSimulation
+{
+public:
+    Registry registry;
+    PetStats stats;
+
+    Entity SpawnPet(const Renderable &renderable, const glm::vec3 &home, float scale, uint32_t seed)
+    {
+        Entity pet = registry.Create();
+        Wander wander;
+        wander.home = home;
+        wander.seed = seed | 1u;
+        wander.radius = 1.5f + 2.0f * random(wander.seed);
+        wander.speed = 0.3f + 0.5f * random(wander.seed);
+        wander.targetHeading = random(wander.seed) * TWO_PI;
+        wander.turnTimer = random(wander.seed) * 3.0f;
+        registry.Add<Wander>(pet, wander);
+        registry.Add<PetTransform>(pet, placement(home, wander.targetHeading, scale));
+        registry.Add<Renderable>(pet, renderable);
+        stats.pets++;
+        return pet;
+    }
+
+    // props never move, their matrix is built once here. orientation is applied first, for models
+    // that do not stand upright on their own
+    Entity SpawnProp(const Renderable &renderable, const glm::vec3 &position, float heading, float scale,
+                     const glm::mat4 &orientation = glm::mat4(1.0f))
+    {
+        Entity prop = registry.Create();
+        PetTransform transform = placement(position, heading, scale);
+        transform.world = transform.world * orientation;
+        registry.Add<PetTransform>(prop, transform);
+        registry.Add<Renderable>(prop, renderable);
+        stats.props++;
+        return prop;
+    }
+
+    void Update(float deltaTime, ThreadPool &threads)
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        // long frames, e.g. while the window is dragged, would make the pets jump
+        deltaTime = std::fmin(deltaTime, 0.1f);
+        registry.ParallelEach<Wander, PetTransform>(threads, [deltaTime](Entity, Wander &wander, PetTransform &transform) {
+            Step(wander, transform, deltaTime);
+        });
+        stats.updateMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // appends the world matrices of the entities drawn with model that are inside the frustum
+    void Collect(const Model *model, const Frustum &frustum, std::vector<glm::mat4> &worlds)
+    {
+        registry.Each<Renderable, PetTransform>([&](Entity, Renderable &renderable, PetTransform &transform) {
+            if (renderable.model == model && frustum.Intersects(renderable.sphere.Transform(transform.world)))
+                worlds.push_back(transform.world);
+        });
+    }
+
+    // one frame of the wander behaviour
+    static void Step(Wander &wander, PetTransform &transform, float deltaTime)
+    {
+        wander.turnTimer -= deltaTime;
+        if (wander.turnTimer <= 0.0f)
+        {
+            wander.targetHeading = random(wander.seed) * TWO_PI;
+            wander.turnTimer = 1.0f + 3.0f * random(wander.seed);
+        }
+        // too far from home, head back
+        glm::vec3 offset = transform.position - wander.home;
+        if (offset.x * offset.x + offset.z * offset.z > wander.radius * wander.radius)
+            wander.targetHeading = std::atan2(-offset.x, -offset.z);
+
+        // turn the short way round at a limited rate
+        float turn = std::remainder(wander.targetHeading - transform.heading, TWO_PI);
+        float maxTurn = TURN_RATE * deltaTime;
+        transform.heading += std::fmax(-maxTurn, std::fmin(turn, maxTurn));
+        transform.position.x += std::sin(transform.heading) * wander.speed * deltaTime;
+        transform.position.z += std::cos(transform.heading) * wander.speed * deltaTime;
+        transform.world = worldMatrix(transform);
+    }
+
+private:
+    static constexpr float TWO_PI = 6.2831853f;
+    // radians per second
+    static constexpr float TURN_RATE = 2.0f;
+
+    // xorshift, each pet has its own state so the behaviour can run on any thread
+    static float random(uint32_t &state)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    }
+
+    static PetTransform placement(const glm::vec3 &position, float heading, float scale)
+    {
+        PetTransform transform;
+        transform.position = position;
+        transform.heading = heading;
+        transform.scale = scale;
+        transform.world = worldMatrix(transform);
+        return transform;
+    }
+
+    // translate * rotate around y * uniform scale, written out
+    static glm::mat4 worldMatrix(const PetTransform &transform)
+    {
+        float s = std::sin(transform.heading) * transform.scale;
+        float c = std::cos(transform.heading) * transform.scale;
+        return glm::mat4(glm::vec4(c, 0.0f, -s, 0.0f),
+                         glm::vec4(0.0f, transform.scale, 0.0f, 0.0f),
+                         glm::vec4(s, 0.0f, c, 0.0f),
+                         glm::vec4(transform.position, 1.0f));
+    }
+};
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_extensions.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+struct ProgramCacheStats {
+    // programs created so far and the time spent creating them, linking or loading
+    unsigned int programs = 0;
+    double totalMs = 0.0;
+    unsigned int loaded = 0;
+    unsigned int compiled = 0;
+    unsigned int stored = 0;
+    // binaries that were found but refused by the driver, e.g. after a driver update
+    unsigned int rejected = 0;
+};
+
+// Keeps linked programs on disk as glGetProgramBinary blobs, one file per program in directory. The
+// file name is a hash of the stage sources after the defines went in and of the vendor, renderer and
+// version strings, so editing a shader or changing the driver simply misses. A blob the driver does
+// not take any more is compiled over and written again.
+//
+// Does nothing without ARB_get_program_binary or with enabled switched off; Shader then links as
+// before.
+class ProgramCache
+{
+public:
+    bool enabled = true;
+    std::string directory = "shader_cache";
+    ProgramCacheStats stats;
+
+    bool Active() const { return enabled && GLExt().programBinary; }
+
+    // key for the given stage sources, the driver strings are folded in once
+    uint64_t Key(const std::vector<const std::string *> &sources)
+    {
+        if (driverHash == 0)
+        {
+            driverHash = FNV_OFFSET;
+            for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+            {
+                const char *value = (const char *)glGetString(name);
+                driverHash = hash(driverHash, value ? value : "");
+            }
+        }
+        uint64_t key = driverHash;
+        for (const std::string *source : sources)
+        {
+            key = hash(key, *source);
+            // keeps "ab" + "c" apart from "a" + "bc"
+            key = hash(key, std::string(1, '\0'));
+        }
+        return key;
+    }
+
+    // true if program now holds the cached binary and linked fine
+    bool Load(unsigned int program, uint64_t key)
+    {
+        std::ifstream file(path(key), std::ios::binary);
+        if (!file)
+            return false;
+        Header header;
+        if (!file.read((char *)&header, sizeof(header)) || header.magic != MAGIC || header.length == 0)
+            return false;
+        std::vector<char> binary(header.length);
+        if (!file.read(&binary[0], binary.size()))
+            return false;
+
+        GLExt().ProgramBinary(program, header.format, &binary[0], header.length);
+        GLint linked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            stats.rejected++;
+            return false;
+        }
+        stats.loaded++;
+        return true;
+    }
+
+    // before glLinkProgram, without the hint some drivers keep nothing to hand out
+    void PrepareLink(unsigned int program)
+    {
+        GLExt().ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // after a successful link
+    void Store(unsigned int program, uint64_t key)
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        Header header;
+        header.magic = MAGIC;
+        GLsizei written = 0;
+        GLExt().GetProgramBinary(program, length, &written, &header.format, &binary[0]);
+        if (written <= 0)
+            return;
+        header.length = written;
+
+        if (!directoryCreated)
+        {
+#ifdef _WIN32
+            _mkdir(directory.c_str());
+#else
+            mkdir(directory.c_str(), 0755);
+#endif
+            directoryCreated = true;
+        }
+        std::ofstream file(path(key), std::ios::binary | std::ios::trunc);
+        if (!file.write((const char *)&header, sizeof(header)) || !file.write(&binary[0], written))
+        {
+            std::cout << "ERROR::PROGRAM_CACHE::WRITE_FAILED " << path(key) << std::endl;
+            return;
+        }
+        stats.stored++;
+    }
+
+private:
+    static const uint32_t MAGIC = 0x31504750; // "PGP1"
+    static const uint64_t FNV_OFFSET = 14695981039346656037ull;
+    static const uint64_t FNV_PRIME = 1099511628211ull;
+
+    struct Header {
+        uint32_t magic = 0;
+        GLenum format = 0;
+        uint32_t length = 0;
+    };
+
+    uint64_t driverHash = 0;
+    bool directoryCreated = false;
+
+    // FNV-1a, 64 bit
+    static uint64_t hash(uint64_t value, const std::string &data)
+    {
+        for (unsigned char c : data)
+        {
+            value ^= c;
+            value *= FNV_PRIME;
+        }
+        return value;
+    }
+
+    std::string path(uint64_t key) const
+    {
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+        return directory + "/" + name + ".bin";
+    }
+};
+
+inline ProgramCache &GlobalProgramCache()
+{
+    static ProgramCache cache;
+    return cache;
+}
+
+#endif
@@ -0,0 +1,415 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader.h>
+#include <learnopengl/transforms.h>
+#include <learnopengl/upload_ring.h>
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Passes are the most significant part of the sort key, so everything in a lower pass is drawn first.
+enum RenderPass {
+    RENDER_PASS_GEOMETRY = 0,  // deferred G-buffer fill
+    RENDER_PASS_OPAQUE,
+    RENDER_PASS_SKYBOX,
+    RENDER_PASS_COUNT
+};
+
+// One texture of a material: which unit it goes to is its index in the material.
+struct MaterialTexture {
+    GLenum target;
+    unsigned int id;
+    std::string sampler;
+
+    bool operator<(const MaterialTexture &other) const
+    {
+        if (target != other.target) return target < other.target;
+        if (id != other.id) return id < other.id;
+        return sampler < other.sampler;
+    }
+};
+
+struct DrawPacket {
+    Shader *shader;
+    unsigned int material;
+    unsigned int VAO;
+    GLenum mode;
+    bool indexed;
+    GLsizei count;
+    // 0 for plain draws, otherwise the VAO supplies per-instance data
+    GLsizei instanceCount;
+    bool hasModel;
+    glm::mat4 model;
+    // ObjectData already in the upload ring (see TransformSystem), -1 when the queue writes it
+    GLintptr objectOffset;
+};
+
+struct RenderQueueStats {
+    unsigned int packets = 0;
+    unsigned int drawCalls = 0;
+    // copies drawn by instanced packets
+    unsigned int instances = 0;
+    unsigned int programChanges = 0;
+    unsigned int materialChanges = 0;
+    unsigned int vaoChanges = 0;
+    // what the same packets cost when every draw binds its own state, like Mesh::Draw does
+    unsigned int naiveStateChanges = 0;
+    // what the same packets cost in submission order with redundant binds skipped
+    unsigned int unsortedStateChanges = 0;
+    // packets not drawn because their ObjectData did not fit into the upload ring
+    unsigned int dropped = 0;
+
+    unsigned int StateChanges() const { return programChanges + materialChanges + vaoChanges; }
+};
+
+// Collects draw packets for a frame, sorts them by a packed 64-bit state key and issues them
+// while skipping program, texture and VAO binds that are already current.
+// Model and normal matrices of programs with an ObjectData block are written to the upload ring in one go
+// and bound per draw with glBindBufferRange, other programs still get the "model" uniform.
+// Packets submitted with a TransformSystem entry reuse the data it uploaded.
+//
+// key layout (msb -> lsb): pass 4 | program 10 | material 14 | vao 16 | depth 20
+// Indices past their field width are masked, so they still draw correctly but share sort slots with
+// lower ones; the first one of each field is reported.
+class RenderQueue
+{
+public:
+    // sorts into the highest material slot, after all textured packets of the same program
+    static const unsigned int NO_MATERIAL = 0xFFFFFFFFu;
+
+    RenderQueueStats stats;
+    // called when execution enters/leaves a pass, e.g. to change depth state for the skybox.
+    // The queue assumes nothing about bound state after a pass hook ran.
+    std::function<void()> passBegin[RENDER_PASS_COUNT];
+    std::function<void()> passEnd[RENDER_PASS_COUNT];
+
+    explicit RenderQueue(UploadRing &ring) : ring(ring) {}
+
+    // starts a new frame, depth in the sort key is the distance from viewPosition scaled by farPlane
+    void Begin(const glm::vec3 &viewPosition, float farPlane)
+    {
+        this->viewPosition = viewPosition;
+        this->farPlane = farPlane;
+        packets.clear();
+        keys.clear();
+    }
+
+    // returns a material index for the given texture set, identical sets share one index
+    unsigned int RegisterMaterial(const std::vector<MaterialTexture> &textures)
+    {
+        auto it = materialIndices.find(textures);
+        if (it != materialIndices.end())
+            return it->second;
+        unsigned int index = materials.size();
+        if (index == MATERIAL_MASK)
+            std::cout << "ERROR::RENDER_QUEUE::TOO_MANY_MATERIALS, more than " << MATERIAL_MASK
+                      << " no longer sort apart" << std::endl;
+        materials.push_back(textures);
+        materialIndices[textures] = index;
+        return index;
+    }
+
+    void SubmitArrays(RenderPass pass, Shader &shader, unsigned int material, unsigned int VAO, GLsizei count)
+    {
+        submit(pass, shader, material, VAO, GL_TRIANGLES, false, count, 0, false, glm::mat4(1.0f));
+    }
+    void SubmitArrays(RenderPass pass, Shader &shader, unsigned int material, unsigned int VAO, GLsizei count, const glm::mat4 &model)
+    {
+        submit(pass, shader, material, VAO, GL_TRIANGLES, false, count, 0, true, model);
+    }
+    void SubmitIndexed(RenderPass pass, Shader &shader, unsigned int material, unsigned int VAO, GLsizei count, const glm::mat4 &model)
+    {
+        submit(pass, shader, material, VAO, GL_TRIANGLES, true, count, 0, true, model);
+    }
+    // the transforms have to be uploaded for this frame already
+    void SubmitArrays(RenderPass pass, Shader &shader, unsigned int material, unsigned int VAO, GLsizei count,
+                      const TransformSystem &transforms, unsigned int transform)
+    {
+        submit(pass, shader, material, VAO, GL_TRIANGLES, false, count, 0, true, transforms.World(transform), transforms.Offset(transform));
+    }
+    void SubmitIndexed(RenderPass pass, Shader &shader, unsigned int material, unsigned int VAO, GLsizei count,
+                       const TransformSystem &transforms, unsigned int transform)
+    {
+        submit(pass, shader, material, VAO, GL_TRIANGLES, true, count, 0, true, transforms.World(transform), transforms.Offset(transform));
+    }
+    // instanced packets have no model matrix, the VAO has to read per-instance transforms (see InstanceBuffer)
+    void SubmitArraysInstanced(RenderPass pass, Shader &shader, unsigned int material, unsigned int VAO, GLsizei count, GLsizei instanceCount)
+    {
+        submit(pass, shader, material, VAO, GL_TRIANGLES, false, count, instanceCount, false, glm::mat4(1.0f));
+    }
+    void SubmitIndexedInstanced(RenderPass pass, Shader &shader, unsigned int material, unsigned int VAO, GLsizei count, GLsizei instanceCount)
+    {
+        submit(pass, shader, material, VAO, GL_TRIANGLES, true, count, instanceCount, false, glm::mat4(1.0f));
+    }
+
+    // sorts the frame's packets and draws them
+    void Execute()
+    {
+        stats = RenderQueueStats();
+        stats.packets = packets.size();
+        stats.naiveStateChanges = 3 * packets.size();
+        stats.unsortedStateChanges = countUnsortedStateChanges();
+
+        radixSort();
+        writeObjectData();
+
+        unsigned int boundProgram = 0;
+        unsigned int boundMaterial = NO_MATERIAL;
+        unsigned int boundVAO = 0;
+        Shader::Uniform<glm::mat4> modelUniform;
+        int currentPass = -1;
+        for (const SortItem &item : keys)
+        {
+            const DrawPacket &packet = packets[item.index];
+            int pass = (int)(item.key >> PASS_SHIFT);
+            if (pass != currentPass)
+            {
+                if (currentPass >= 0 && passEnd[currentPass])
+                    passEnd[currentPass]();
+                currentPass = pass;
+                if (passBegin[currentPass])
+                    passBegin[currentPass]();
+                boundProgram = 0;
+                boundMaterial = NO_MATERIAL;
+                boundVAO = 0;
+            }
+            if (objectOffsets[item.index] == OBJECT_DROPPED)
+            {
+                stats.dropped++;
+                continue;
+            }
+            if (packet.shader->ID != boundProgram)
+            {
+                packet.shader->use();
+                boundProgram = packet.shader->ID;
+                modelUniform = modelUniformFor(*packet.shader);
+                // sampler uniforms are per program, so the material has to be set up again
+                boundMaterial = NO_MATERIAL;
+                stats.programChanges++;
+            }
+            if (packet.material != boundMaterial && packet.material != NO_MATERIAL)
+            {
+                bindMaterial(*packet.shader, packet.material);
+                boundMaterial = packet.material;
+                stats.materialChanges++;
+            }
+            if (packet.VAO != boundVAO)
+            {
+                glBindVertexArray(packet.VAO);
+                boundVAO = packet.VAO;
+                stats.vaoChanges++;
+            }
+            if (packet.hasModel)
+            {
+                if (objectOffsets[item.index] >= 0)
+                    glBindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_OBJECT, ring.ID, objectOffsets[item.index], sizeof(GpuObjectData));
+                else
+                    packet.shader->set(modelUniform, packet.model);
+            }
+
+            if (packet.instanceCount > 0)
+            {
+                if (packet.indexed)
+                    glDrawElementsInstanced(packet.mode, packet.count, GL_UNSIGNED_INT, 0, packet.instanceCount);
+                else
+                    glDrawArraysInstanced(packet.mode, 0, packet.count, packet.instanceCount);
+                stats.instances += packet.instanceCount;
+            }
+            else if (packet.indexed)
+                glDrawElements(packet.mode, packet.count, GL_UNSIGNED_INT, 0);
+            else
+                glDrawArrays(packet.mode, 0, packet.count);
+            stats.drawCalls++;
+        }
+        if (currentPass >= 0 && passEnd[currentPass])
+            passEnd[currentPass]();
+
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    // objectOffsets entry of a packet whose ObjectData the ring had no room for
+    static const GLintptr OBJECT_DROPPED = -2;
+    static const unsigned int PASS_SHIFT = 60;
+    static const unsigned int PROGRAM_SHIFT = 50;
+    static const unsigned int MATERIAL_SHIFT = 36;
+    static const unsigned int VAO_SHIFT = 20;
+    static const uint64_t PROGRAM_MASK = (1u << 10) - 1;
+    static const uint64_t MATERIAL_MASK = (1u << 14) - 1;
+    static const uint64_t VAO_MASK = (1u << 16) - 1;
+    static const uint64_t DEPTH_MASK = (1u << 20) - 1;
+
+    struct SortItem {
+        uint64_t key;
+        unsigned int index;
+    };
+
+    UploadRing &ring;
+    std::vector<DrawPacket> packets;
+    // where each packet's ObjectData is in the ring this frame, -1 when its program uses the model uniform
+    std::vector<GLintptr> objectOffsets;
+    std::vector<SortItem> keys;
+    std::vector<SortItem> scratch;
+    std::vector<std::vector<MaterialTexture>> materials;
+    std::map<std::vector<MaterialTexture>, unsigned int> materialIndices;
+    // GL names are sparse, the key stores small dense indices instead
+    std::unordered_map<unsigned int, uint64_t> programIndices;
+    std::unordered_map<unsigned int, uint64_t> vaoIndices;
+    // uniform handles resolved the first time a program (and material) is seen
+    std::unordered_map<unsigned int, Shader::Uniform<glm::mat4>> modelUniforms;
+    std::unordered_map<uint64_t, std::vector<Shader::Uniform<int>>> samplerUniforms;
+
+    glm::vec3 viewPosition = glm::vec3(0.0f);
+    float farPlane = 100.0f;
+
+    void submit(RenderPass pass, Shader &shader, unsigned int material, unsigned int VAO, GLenum mode, bool indexed,
+                GLsizei count, GLsizei instanceCount, bool hasModel, const glm::mat4 &model, GLintptr objectOffset = -1)
+    {
+        DrawPacket packet;
+        packet.shader = &shader;
+        packet.material = material;
+        packet.VAO = VAO;
+        packet.mode = mode;
+        packet.indexed = indexed;
+        packet.count = count;
+        packet.instanceCount = instanceCount;
+        packet.hasModel = hasModel;
+        packet.model = model;
+        packet.objectOffset = objectOffset;
+
+        // opaque geometry goes front to back so early depth testing rejects as much as possible
+        uint64_t depth = 0;
+        if (hasModel)
+        {
+            float distance = glm::length(glm::vec3(model[3]) - viewPosition) / farPlane;
+            distance = glm::clamp(distance, 0.0f, 1.0f);
+            depth = (uint64_t)(distance * (float)DEPTH_MASK);
+        }
+
+        uint64_t key = ((uint64_t)pass << PASS_SHIFT)
+                     | ((denseIndex(programIndices, shader.ID, PROGRAM_MASK, "PROGRAMS") & PROGRAM_MASK) << PROGRAM_SHIFT)
+                     | (((uint64_t)material & MATERIAL_MASK) << MATERIAL_SHIFT)
+                     | ((denseIndex(vaoIndices, VAO, VAO_MASK, "VAOS") & VAO_MASK) << VAO_SHIFT)
+                     | depth;
+
+        keys.push_back({key, (unsigned int)packets.size()});
+        packets.push_back(packet);
+    }
+
+    // copies the matrices into the ring before the first draw, so it only has to be flushed once
+    void writeObjectData()
+    {
+        objectOffsets.assign(packets.size(), -1);
+        bool written = false;
+        for (const SortItem &item : keys)
+        {
+            const DrawPacket &packet = packets[item.index];
+            if (!packet.hasModel || !packet.shader->hasUniformBlock(UNIFORM_BLOCK_OBJECT))
+                continue;
+            if (packet.objectOffset >= 0)
+            {
+                objectOffsets[item.index] = packet.objectOffset;
+                continue;
+            }
+            GpuObjectData data = {packet.model, NormalMatrix(packet.model)};
+            if (ring.WriteUniform(&data, sizeof(GpuObjectData), objectOffsets[item.index]))
+                written = true;
+            else
+                objectOffsets[item.index] = OBJECT_DROPPED;
+        }
+        if (written)
+            ring.Flush();
+    }
+
+    static uint64_t denseIndex(std::unordered_map<unsigned int, uint64_t> &indices, unsigned int name, uint64_t mask,
+                               const char *what)
+    {
+        auto it = indices.find(name);
+        if (it != indices.end())
+            return it->second;
+        uint64_t index = indices.size();
+        if (index == mask + 1)
+            std::cout << "ERROR::RENDER_QUEUE::TOO_MANY_" << what << ", more than " << mask + 1
+                      << " no longer sort apart" << std::endl;
+        indices[name] = index;
+        return index;
+    }
+
+    Shader::Uniform<glm::mat4> modelUniformFor(const Shader &shader)
+    {
+        auto it = modelUniforms.find(shader.ID);
+        if (it == modelUniforms.end())
+            it = modelUniforms.insert({shader.ID, shader.uniform<glm::mat4>("model")}).first;
+        return it->second;
+    }
+
+    void bindMaterial(const Shader &shader, unsigned int material)
+    {
+        const std::vector<MaterialTexture> &textures = materials[material];
+        uint64_t key = ((uint64_t)shader.ID << 32) | material;
+        auto it = samplerUniforms.find(key);
+        if (it == samplerUniforms.end())
+        {
+            std::vector<Shader::Uniform<int>> samplers;
+            for (const MaterialTexture &texture : textures)
+                samplers.push_back(shader.uniform<int>(texture.sampler));
+            it = samplerUniforms.insert({key, samplers}).first;
+        }
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            shader.set(it->second[i], (int)i);
+            glBindTexture(textures[i].target, textures[i].id);
+        }
+    }
+
+    unsigned int countUnsortedStateChanges() const
+    {
+        unsigned int changes = 0;
+        unsigned int program = 0, material = NO_MATERIAL, VAO = 0;
+        for (const DrawPacket &packet : packets)
+        {
+            if (packet.shader->ID != program) { program = packet.shader->ID; material = NO_MATERIAL; changes++; }
+            if (packet.material != material && packet.material != NO_MATERIAL) { material = packet.material; changes++; }
+            if (packet.VAO != VAO) { VAO = packet.VAO; changes++; }
+        }
+        return changes;
+    }
+
+    // LSD radix sort over 8-bit digits, digits that are the same for every key are skipped
+    void radixSort()
+    {
+        scratch.resize(keys.size());
+        for (unsigned int shift = 0; shift < 64; shift += 8)
+        {
+            unsigned int counts[256] = {0};
+            for (const SortItem &item : keys)
+                counts[(item.key >> shift) & 0xFF]++;
+            if (counts[(keys.empty() ? 0 : (keys[0].key >> shift) & 0xFF)] == keys.size())
+                continue;
+
+            unsigned int offset = 0;
+            for (unsigned int i = 0; i < 256; i++)
+            {
+                unsigned int count = counts[i];
+                counts[i] = offset;
+                offset += count;
+            }
+            for (const SortItem &item : keys)
+                scratch[counts[(item.key >> shift) & 0xFF]++] = item;
+            keys.swap(scratch);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,282 @@
+#ifndef RENDER_TARGETS_H
+#define RENDER_TARGETS_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <initializer_list>
+#include <iostream>
+#include <map>
+#include <vector>
+
+// what a render target texture is made of, two targets with equal descriptors are interchangeable
+struct RenderTargetDesc {
+    unsigned int width;
+    unsigned int height;
+    GLenum internalFormat;
+    // above 1 makes a GL_TEXTURE_2D_MULTISAMPLE texture
+    unsigned int samples = 1;
+    GLenum filter = GL_LINEAR;
+
+    bool operator==(const RenderTargetDesc &other) const
+    {
+        return width == other.width && height == other.height && internalFormat == other.internalFormat &&
+               samples == other.samples && filter == other.filter;
+    }
+};
+
+struct RenderTargetStats {
+    unsigned int targets = 0;
+    unsigned int inUse = 0;
+    unsigned int framebuffers = 0;
+    size_t bytes = 0;
+    size_t peakBytes = 0;
+    // during the last frame
+    unsigned int allocations = 0;
+    unsigned int reuses = 0;
+};
+
+// Owns the textures passes render into. A pass acquires a target by descriptor and releases it once
+// nothing later in the frame reads it, the next Acquire() with the same descriptor gets the same
+// texture back, so transient targets of different passes share memory. Targets nobody acquired for
+// keepFrames frames are deleted, which is how old sizes disappear after the window is resized:
+// callers simply start asking for the new size.
+//
+// Framebuffers are cached by their attachments and deleted together with the textures. Destroy()
+// frees everything and has to run while the context is still current, the destructor leaves GL alone.
+class RenderTargetPool
+{
+public:
+    unsigned int keepFrames = 3;
+    RenderTargetStats stats;
+
+    // deletes every target and framebuffer, the pool can be used again afterwards
+    void Destroy()
+    {
+        for (Target &target : targets)
+            glDeleteTextures(1, &target.texture);
+        for (std::map<std::vector<unsigned int>, unsigned int>::value_type &entry : framebuffers)
+            glDeleteFramebuffers(1, &entry.second);
+        targets.clear();
+        framebuffers.clear();
+        stats.framebuffers = 0;
+        updateStats();
+    }
+
+    // once per frame, before the first Acquire()
+    void BeginFrame()
+    {
+        frame++;
+        stats.allocations = 0;
+        stats.reuses = 0;
+        for (unsigned int i = 0; i < targets.size();)
+        {
+            if (!targets[i].inUse && frame - targets[i].lastUsed > keepFrames)
+            {
+                destroy(targets[i]);
+                targets[i] = targets.back();
+                targets.pop_back();
+            }
+            else
+                i++;
+        }
+        updateStats();
+    }
+
+    // texture matching desc that no one else holds until it is released
+    unsigned int Acquire(const RenderTargetDesc &desc)
+    {
+        for (Target &target : targets)
+        {
+            if (!target.inUse && target.desc == desc)
+            {
+                target.inUse = true;
+                target.lastUsed = frame;
+                stats.reuses++;
+                updateStats();
+                return target.texture;
+            }
+        }
+        Target target;
+        target.desc = desc;
+        target.texture = create(desc);
+        target.inUse = true;
+        target.lastUsed = frame;
+        targets.push_back(target);
+        stats.allocations++;
+        updateStats();
+        return target.texture;
+    }
+
+    void Release(unsigned int texture)
+    {
+        for (Target &target : targets)
+        {
+            if (target.texture == texture)
+            {
+                target.inUse = false;
+                updateStats();
+                return;
+            }
+        }
+        std::cout << "ERROR::RENDER_TARGETS::RELEASE_OF_UNKNOWN_TEXTURE " << texture << std::endl;
+    }
+
+    // framebuffer drawing into the colors in order and the depth stencil target, 0 for none.
+    // Only valid while the textures are held
+    unsigned int Framebuffer(std::initializer_list<unsigned int> colors, unsigned int depthStencil = 0)
+    {
+        return Framebuffer(std::vector<unsigned int>(colors), depthStencil);
+    }
+
+    unsigned int Framebuffer(const std::vector<unsigned int> &colors, unsigned int depthStencil = 0)
+    {
+        std::vector<unsigned int> key(colors);
+        key.push_back(depthStencil);
+        std::map<std::vector<unsigned int>, unsigned int>::iterator found = framebuffers.find(key);
+        if (found != framebuffers.end())
+            return found->second;
+
+        unsigned int framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        std::vector<GLenum> drawBuffers;
+        for (unsigned int texture : colors)
+        {
+            GLenum attachment = GL_COLOR_ATTACHMENT0 + drawBuffers.size();
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, textureTarget(texture), texture, 0);
+            drawBuffers.push_back(attachment);
+        }
+        if (depthStencil != 0)
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, textureTarget(depthStencil), depthStencil, 0);
+        if (drawBuffers.empty())
+            glDrawBuffer(GL_NONE);
+        else
+            glDrawBuffers(drawBuffers.size(), &drawBuffers[0]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::RENDER_TARGETS::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+        framebuffers[key] = framebuffer;
+        stats.framebuffers = framebuffers.size();
+        return framebuffer;
+    }
+
+    static bool IsDepthFormat(GLenum internalFormat)
+    {
+        return internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH_COMPONENT32F ||
+               internalFormat == GL_DEPTH_COMPONENT24;
+    }
+
+    static size_t BytesPerPixel(GLenum internalFormat)
+    {
+        switch (internalFormat)
+        {
+        case GL_R8: return 1;
+        case GL_RG8: return 2;
+        case GL_RG16: return 4;
+        case GL_RGB8: return 3;
+        case GL_RGBA8: return 4;
+        case GL_RGBA16F: return 8;
+        case GL_RGBA32F: return 16;
+        case GL_DEPTH24_STENCIL8: return 4;
+        case GL_DEPTH_COMPONENT32F: return 4;
+        default: return 4;
+        }
+    }
+
+private:
+    struct Target {
+        RenderTargetDesc desc;
+        unsigned int texture;
+        bool inUse;
+        unsigned int lastUsed;
+    };
+
+    std::vector<Target> targets;
+    std::map<std::vector<unsigned int>, unsigned int> framebuffers;
+    unsigned int frame = 0;
+
+    static unsigned int create(const RenderTargetDesc &desc)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        if (desc.samples > 1)
+        {
+            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture);
+            glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, desc.internalFormat, desc.width, desc.height, GL_TRUE);
+            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+            return texture;
+        }
+        GLenum format, type;
+        pixelFormat(desc.internalFormat, format, type);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width, desc.height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, desc.filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, desc.filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    // any format/type pair that fits, no pixels are uploaded
+    static void pixelFormat(GLenum internalFormat, GLenum &format, GLenum &type)
+    {
+        type = GL_UNSIGNED_BYTE;
+        switch (internalFormat)
+        {
+        case GL_R8: format = GL_RED; break;
+        case GL_RG8: format = GL_RG; break;
+        case GL_RG16: format = GL_RG; type = GL_UNSIGNED_SHORT; break;
+        case GL_RGB8: format = GL_RGB; break;
+        case GL_RGBA16F: case GL_RGBA32F: format = GL_RGBA; type = GL_FLOAT; break;
+        case GL_DEPTH24_STENCIL8: format = GL_DEPTH_STENCIL; type = GL_UNSIGNED_INT_24_8; break;
+        case GL_DEPTH_COMPONENT32F: format = GL_DEPTH_COMPONENT; type = GL_FLOAT; break;
+        default: format = GL_RGBA; break;
+        }
+    }
+
+    GLenum textureTarget(unsigned int texture) const
+    {
+        for (const Target &target : targets)
+            if (target.texture == texture)
+                return target.desc.samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+        return GL_TEXTURE_2D;
+    }
+
+    void destroy(Target &target)
+    {
+        for (std::map<std::vector<unsigned int>, unsigned int>::iterator it = framebuffers.begin(); it != framebuffers.end();)
+        {
+            bool attached = false;
+            for (unsigned int texture : it->first)
+                attached = attached || texture == target.texture;
+            if (attached)
+            {
+                glDeleteFramebuffers(1, &it->second);
+                it = framebuffers.erase(it);
+            }
+            else
+                ++it;
+        }
+        glDeleteTextures(1, &target.texture);
+        stats.framebuffers = framebuffers.size();
+    }
+
+    void updateStats()
+    {
+        stats.targets = targets.size();
+        stats.inUse = 0;
+        stats.bytes = 0;
+        for (const Target &target : targets)
+        {
+            if (target.inUse)
+                stats.inUse++;
+            stats.bytes += (size_t)target.desc.width * target.desc.height * BytesPerPixel(target.desc.internalFormat) *
+                           (target.desc.samples > 1 ? target.desc.samples : 1);
+        }
+        if (stats.bytes > stats.peakBytes)
+            stats.peakBytes = stats.bytes;
+    }
+};
+
+#endif
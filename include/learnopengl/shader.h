@@ -4,19 +4,45 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <chrono>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
 #include <common.h>
+#include <learnopengl/program_cache.h>
+#include <learnopengl/uniform_blocks.h>
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+
+    // pre-resolved uniform location, get one with uniform<T>(name) after the program is linked
+    template<typename T>
+    struct Uniform
+    {
+        GLint location = -1;
+        bool valid() const { return location != -1; }
+    };
+
+    // what glGetActiveUniform reported for a uniform at link time
+    struct UniformInfo
+    {
+        GLint location;
+        GLenum type;
+        GLint size;
+    };
+    // constructor generates the shader on the fly. defines, e.g. "#define INSTANCED\n", is put
+    // right after the #version line of every stage, see ShaderPermutations. Linked programs come
+    // from GlobalProgramCache() when it has them.
+    // With finishLater the compiles and the link are only issued, nothing asks for their status and
+    // the program cannot be used until Finish(), so the driver can work on it in the meantime
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+           const std::string &defines = std::string(), bool finishLater = false)
     {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
         std::string vertexPathString(vertexPath);
         std::string fragmentPathString(fragmentPath);
 
@@ -64,6 +90,27 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        if (!defines.empty())
+        {
+            vertexCode = injectDefines(vertexCode, defines);
+            fragmentCode = injectDefines(fragmentCode, defines);
+            if (geometryPath != nullptr)
+                geometryCode = injectDefines(geometryCode, defines);
+        }
+        ProgramCache &cache = GlobalProgramCache();
+        uint64_t cacheKey = 0;
+        ID = glCreateProgram();
+        if (cache.Active())
+        {
+            cacheKey = cache.Key({&vertexCode, &fragmentCode, &geometryCode});
+            if (cache.Load(ID, cacheKey))
+            {
+                reflectUniforms();
+                bindUniformBlocks();
+                countCreation(elapsedMs(start));
+                return;
+            }
+        }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
         // 2. compile shaders
@@ -72,36 +119,69 @@ public:
         vertex = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex, 1, &vShaderCode, NULL);
         glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
         // fragment Shader
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
         glShaderSource(fragment, 1, &fShaderCode, NULL);
         glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
         // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
+        unsigned int geometry = 0;
         if(geometryPath != nullptr)
         {
             const char * gShaderCode = geometryCode.c_str();
             geometry = glCreateShader(GL_GEOMETRY_SHADER);
             glShaderSource(geometry, 1, &gShaderCode, NULL);
             glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
         }
         // shader Program
-        ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
         if(geometryPath != nullptr)
             glAttachShader(ID, geometry);
+        if (cache.Active())
+            cache.PrepareLink(ID);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+        stages[0] = vertex;
+        stages[1] = fragment;
+        stages[2] = geometry;
+        this->cacheKey = cacheKey;
+        linking = true;
+        issueMs = elapsedMs(start);
+        if (!finishLater)
+            Finish();
+    }
+    // false while a program made with finishLater is still being compiled or linked by the driver.
+    // Without parallel shader compile there is no way to tell, it is always ready and Finish() waits
+    bool Ready() const
+    {
+        if (!linking || !GLExt().parallelShaderCompile)
+            return true;
+        GLint done = GL_FALSE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+    bool Linking() const { return linking; }
+    // checks the compiles and the link, then reads the uniforms back; waits if the driver is not done
+    void Finish()
+    {
+        if (!linking)
+            return;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        linking = false;
+        checkCompileErrors(stages[0], "VERTEX");
+        checkCompileErrors(stages[1], "FRAGMENT");
+        if (stages[2] != 0)
+            checkCompileErrors(stages[2], "GEOMETRY");
+        ProgramCache &cache = GlobalProgramCache();
+        if (checkCompileErrors(ID, "PROGRAM") && cache.Active())
+            cache.Store(ID, cacheKey);
+        cache.stats.compiled++;
+        reflectUniforms();
+        bindUniformBlocks();
         // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
-
+        for (unsigned int stage : stages)
+            if (stage != 0)
+                glDeleteShader(stage);
+        countCreation(issueMs + elapsedMs(start));
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -109,69 +189,240 @@ public:
     { 
         glUseProgram(ID); 
     }
-    // utility uniform functions
+    // returns a typed handle for a uniform, hot paths should keep it instead of setting by name
+    template<typename T>
+    Uniform<T> uniform(const std::string &name) const
+    {
+        Uniform<T> handle;
+        auto it = uniforms.find(name);
+        if (it == uniforms.end())
+            return handle;
+        if (!typeMatches(it->second.type, (T*)nullptr))
+            std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH: " << name << std::endl;
+        handle.location = it->second.location;
+        return handle;
+    }
+    // location of a uniform from the table built at link time, -1 if the program has no such uniform
+    GLint location(const std::string &name) const
+    {
+        auto it = uniforms.find(name);
+        return it != uniforms.end() ? it->second.location : -1;
+    }
+    const std::unordered_map<std::string, UniformInfo> &activeUniforms() const
+    {
+        return uniforms;
+    }
+    // whether the program declares the shared block, see uniform_blocks.h
+    bool hasUniformBlock(UniformBlockBinding binding) const
+    {
+        return (uniformBlocks & (1u << binding)) != 0;
+    }
+    // ------------------------------------------------------------------------
+    void set(Uniform<bool> uniform, bool value) const
+    {
+        glUniform1i(uniform.location, (int)value);
+    }
+    void set(Uniform<int> uniform, int value) const
+    {
+        glUniform1i(uniform.location, value);
+    }
+    void set(Uniform<float> uniform, float value) const
+    {
+        glUniform1f(uniform.location, value);
+    }
+    void set(Uniform<glm::vec2> uniform, const glm::vec2 &value) const
+    {
+        glUniform2fv(uniform.location, 1, &value[0]);
+    }
+    void set(Uniform<glm::vec3> uniform, const glm::vec3 &value) const
+    {
+        glUniform3fv(uniform.location, 1, &value[0]);
+    }
+    void set(Uniform<glm::vec4> uniform, const glm::vec4 &value) const
+    {
+        glUniform4fv(uniform.location, 1, &value[0]);
+    }
+    void set(Uniform<glm::mat2> uniform, const glm::mat2 &mat) const
+    {
+        glUniformMatrix2fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void set(Uniform<glm::mat3> uniform, const glm::mat3 &mat) const
+    {
+        glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void set(Uniform<glm::mat4> uniform, const glm::mat4 &mat) const
+    {
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    // utility uniform functions, these look the name up in the uniform table
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(location(name), (int)value); 
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(location(name), value); 
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(location(name), value); 
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(location(name), 1, &value[0]); 
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(location(name), x, y); 
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(location(name), 1, &value[0]); 
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(location(name), x, y, z); 
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(location(name), 1, &value[0]); 
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) 
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(location(name), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
-    // utility function for checking shader compilation/linking errors.
+    std::unordered_map<std::string, UniformInfo> uniforms;
+    // stage objects and cache key kept from the constructor until Finish()
+    unsigned int stages[3] = {0, 0, 0};
+    uint64_t cacheKey = 0;
+    bool linking = false;
+    // time the constructor spent issuing the work
+    double issueMs = 0.0;
+    // bit per UniformBlockBinding the program uses
+    unsigned int uniformBlocks = 0;
+
+    // enumerates the active uniforms of the linked program into the uniform table.
+    // arrays are stored under "name", "name[0]" and every "name[i]".
+    void reflectUniforms()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            UniformInfo info;
+            glGetActiveUniform(ID, i, maxLength, &length, &info.size, &info.type, &name[0]);
+            std::string uniformName = name.substr(0, length);
+            info.location = glGetUniformLocation(ID, uniformName.c_str());
+            // members of uniform blocks have no location
+            if (info.location == -1)
+                continue;
+            uniforms[uniformName] = info;
+
+            std::string::size_type bracket = uniformName.rfind("[0]");
+            if (bracket == std::string::npos || bracket + 3 != uniformName.size())
+                continue;
+            std::string base = uniformName.substr(0, bracket);
+            uniforms[base] = info;
+            for (GLint element = 1; element < info.size; element++)
+            {
+                std::string elementName = base + "[" + std::to_string(element) + "]";
+                UniformInfo elementInfo = info;
+                elementInfo.location = glGetUniformLocation(ID, elementName.c_str());
+                elementInfo.size = 1;
+                uniforms[elementName] = elementInfo;
+            }
+        }
+    }
+
+    // points the shared uniform blocks the program uses at their fixed binding points
+    void bindUniformBlocks()
+    {
+        for (unsigned int binding = 0; binding < UNIFORM_BLOCK_COUNT; binding++)
+        {
+            GLuint index = glGetUniformBlockIndex(ID, uniformBlockNames[binding]);
+            if (index != GL_INVALID_INDEX)
+            {
+                glUniformBlockBinding(ID, index, binding);
+                uniformBlocks |= 1u << binding;
+            }
+        }
+    }
+
+    static bool isSampler(GLenum type)
+    {
+        switch (type)
+        {
+            case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+            case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_2D_ARRAY_SHADOW:
+            case GL_SAMPLER_BUFFER: case GL_INT_SAMPLER_BUFFER: case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+            case GL_SAMPLER_2D_MULTISAMPLE: case GL_UNSIGNED_INT_SAMPLER_2D: case GL_INT_SAMPLER_2D:
+                return true;
+        }
+        return false;
+    }
+    static bool typeMatches(GLenum type, bool*) { return type == GL_BOOL; }
+    static bool typeMatches(GLenum type, int*) { return type == GL_INT || type == GL_BOOL || isSampler(type); }
+    static bool typeMatches(GLenum type, float*) { return type == GL_FLOAT; }
+    static bool typeMatches(GLenum type, glm::vec2*) { return type == GL_FLOAT_VEC2; }
+    static bool typeMatches(GLenum type, glm::vec3*) { return type == GL_FLOAT_VEC3; }
+    static bool typeMatches(GLenum type, glm::vec4*) { return type == GL_FLOAT_VEC4; }
+    static bool typeMatches(GLenum type, glm::mat2*) { return type == GL_FLOAT_MAT2; }
+    static bool typeMatches(GLenum type, glm::mat3*) { return type == GL_FLOAT_MAT3; }
+    static bool typeMatches(GLenum type, glm::mat4*) { return type == GL_FLOAT_MAT4; }
+
+    static double elapsedMs(std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    static void countCreation(double ms)
+    {
+        ProgramCacheStats &stats = GlobalProgramCache().stats;
+        stats.programs++;
+        stats.totalMs += ms;
+    }
+
+    // #version has to stay the first line, the defines go in after it
+    static std::string injectDefines(const std::string &code, const std::string &defines)
+    {
+        std::string::size_type version = code.find("#version");
+        if (version == std::string::npos)
+            return defines + code;
+        std::string::size_type lineEnd = code.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return code + "\n" + defines;
+        return code.substr(0, lineEnd + 1) + defines + code.substr(lineEnd + 1);
+    }
+
+    // utility function for checking shader compilation/linking errors, false if there were any.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -193,6 +444,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != 0;
     }
 };
 #endif
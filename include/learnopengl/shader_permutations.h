@@ -0,0 +1,72 @@
+#ifndef SHADER_PERMUTATIONS_H
+#define SHADER_PERMUTATIONS_H
+
+#include <learnopengl/shader.h>
+#include <learnopengl/shader_registry.h>
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+// Feature bits a shader can be specialized for. Each one is a #define in the source, so a variant
+// without a feature does not carry its samplers, attributes or branches.
+enum ShaderFeature : unsigned int {
+    // HAS_SPECULAR_MAP, texture_specular1 scales the specular term, none without it
+    SHADER_FEATURE_SPECULAR_MAP = 1u << 0,
+    // HAS_NORMAL_MAP, texture_normal1 in tangent space with the vertex tangents
+    SHADER_FEATURE_NORMAL_MAP = 1u << 1,
+    // INSTANCED, the model matrix comes from the instance attributes instead of ObjectData
+    SHADER_FEATURE_INSTANCED = 1u << 2,
+    SHADER_FEATURE_ALL = (1u << 3) - 1
+};
+
+const char *const shaderFeatureDefines[] = {"HAS_SPECULAR_MAP", "HAS_NORMAL_MAP", "INSTANCED"};
+
+// The variants of one vertex/fragment pair. Get() takes a variant from the ShaderRegistry the first
+// time its features are asked for and keeps it, features the sources do not implement are dropped
+// from the key so they never make a second, identical program.
+class ShaderPermutations
+{
+public:
+    // called once for every new variant after it linked, to point its samplers at their units and the like
+    std::function<void(Shader &)> setup;
+
+    ShaderPermutations(ShaderRegistry &registry, const std::string &vertexPath, const std::string &fragmentPath,
+                       unsigned int supported = SHADER_FEATURE_ALL)
+        : registry(registry), vertexPath(vertexPath), fragmentPath(fragmentPath), supported(supported)
+    {
+    }
+
+    Shader &Get(unsigned int features)
+    {
+        unsigned int key = features & supported;
+        std::unordered_map<unsigned int, Shader *>::iterator found = variants.find(key);
+        if (found != variants.end())
+            return *found->second;
+        // the program may be shared with someone outside, setup still runs once for this set
+        Shader *shader = &registry.Get(vertexPath, fragmentPath, std::string(), Defines(key));
+        variants[key] = shader;
+        if (setup)
+            registry.WhenLinked(*shader, setup);
+        return *shader;
+    }
+
+    unsigned int Variants() const { return variants.size(); }
+
+    static std::string Defines(unsigned int features)
+    {
+        std::string defines;
+        for (unsigned int bit = 0; (1u << bit) <= SHADER_FEATURE_ALL; bit++)
+            if (features & (1u << bit))
+                defines += std::string("#define ") + shaderFeatureDefines[bit] + "\n";
+        return defines;
+    }
+
+private:
+    ShaderRegistry &registry;
+    std::string vertexPath, fragmentPath;
+    unsigned int supported;
+    std::unordered_map<unsigned int, Shader *> variants;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef SHADER_REGISTRY_H
+#define SHADER_REGISTRY_H
+
+#include <learnopengl/shader.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct ShaderRegistryStats {
+    unsigned int requests = 0;
+    unsigned int programs = 0;
+    // requests answered with a program that already existed, and what creating them again would have cost
+    unsigned int shared = 0;
+    double createMs = 0.0;
+    double savedMs = 0.0;
+    // last batch: programs in it, time between BeginBatch() and FinishBatch() that other work had,
+    // and how long FinishBatch() still waited
+    unsigned int batched = 0;
+    double batchOverlapMs = 0.0;
+    double batchWaitMs = 0.0;
+};
+
+// Hands out one Shader per combination of stage files and defines. Asking twice for the same
+// sources returns the same program, so the sources are read, compiled and linked once and the
+// RenderQueue sees one program ID, which keeps draws of both users next to each other in the sort.
+// Callers that share a program share its uniforms too: anything that differs between them has to be
+// set before each draw, as the per-draw uniforms already are.
+//
+// Between BeginBatch() and FinishBatch() Get() only issues the compiles and links and returns a
+// program that must not be touched yet, so startup can load models and textures while the driver
+// compiles. Work that needs the linked program goes through WhenLinked().
+class ShaderRegistry
+{
+public:
+    ShaderRegistryStats stats;
+
+    void BeginBatch()
+    {
+        batching = true;
+        batchStart = std::chrono::high_resolution_clock::now();
+        stats.batched = 0;
+    }
+
+    // finishes the batch in the order the driver completes it, then goes back to linking right away
+    void FinishBatch()
+    {
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        stats.batchOverlapMs = std::chrono::duration<double, std::milli>(start - batchStart).count();
+        batching = false;
+        while (!pending.empty())
+        {
+            bool finished = false;
+            for (unsigned int i = 0; i < pending.size();)
+            {
+                if (!pending[i]->shader->Ready())
+                {
+                    i++;
+                    continue;
+                }
+                finish(*pending[i]);
+                pending[i] = pending.back();
+                pending.pop_back();
+                finished = true;
+            }
+            if (!finished)
+                std::this_thread::yield();
+        }
+        stats.batchWaitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // runs ready right away for a linked program, else once FinishBatch() got to it
+    void WhenLinked(Shader &shader, const std::function<void(Shader &)> &ready)
+    {
+        if (!shader.Linking())
+            ready(shader);
+        else
+            callbacks.push_back(std::make_pair(&shader, ready));
+    }
+
+    Shader &Get(const std::string &vertexPath, const std::string &fragmentPath,
+                const std::string &geometryPath = std::string(), const std::string &defines = std::string())
+    {
+        stats.requests++;
+        std::string key = vertexPath + '\n' + fragmentPath + '\n' + geometryPath + '\n' + defines;
+        std::unordered_map<std::string, Entry>::iterator found = programs.find(key);
+        if (found != programs.end())
+        {
+            stats.shared++;
+            // a program still in the batch has not paid for its link yet, finish() counts the hit
+            if (found->second.shader->Linking())
+                found->second.pendingHits++;
+            else
+                stats.savedMs += found->second.createMs;
+            return *found->second.shader;
+        }
+
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        Entry &entry = programs[key];
+        entry.shader.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(),
+                                      geometryPath.empty() ? nullptr : geometryPath.c_str(), defines, batching));
+        if (entry.shader->Linking())
+        {
+            pending.push_back(&entry);
+            stats.batched++;
+        }
+        entry.createMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        stats.programs++;
+        stats.createMs += entry.createMs;
+        return *entry.shader;
+    }
+
+private:
+    struct Entry {
+        std::unique_ptr<Shader> shader;
+        double createMs = 0.0;
+        // requests answered while the program was still linking
+        unsigned int pendingHits = 0;
+    };
+
+    std::unordered_map<std::string, Entry> programs;
+    bool batching = false;
+    std::chrono::high_resolution_clock::time_point batchStart;
+    std::vector<Entry *> pending;
+    std::vector<std::pair<Shader *, std::function<void(Shader &)>>> callbacks;
+
+    void finish(Entry &entry)
+    {
+        Shader &shader = *entry.shader;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        shader.Finish();
+        double finishMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        entry.createMs += finishMs;
+        stats.createMs += finishMs;
+        stats.savedMs += entry.pendingHits * entry.createMs;
+        entry.pendingHits = 0;
+        for (unsigned int i = 0; i < callbacks.size();)
+        {
+            if (callbacks[i].first != &shader)
+            {
+                i++;
+                continue;
+            }
+            callbacks[i].second(shader);
+            callbacks.erase(callbacks.begin() + i);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,370 @@
+#ifndef SHADOWS_H
+#define SHADOWS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/bounds.h>
+#include <learnopengl/instancing.h>
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/uniform_blocks.h>
+#include <learnopengl/upload_ring.h>
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+
+// texture unit of the shadow map array, above the clustered light data
+enum ShadowTextureUnit {
+    SHADOW_UNIT_MAP = 8
+};
+
+static const unsigned int SHADOW_CASCADE_COUNT = 3;
+
+// std140 layout of the ShadowData block, keep in sync with light.fs, light_clustered.fs and deferred_dir.fs
+struct GpuShadowData {
+    glm::mat4 lightViewProjections[SHADOW_CASCADE_COUNT];
+    glm::vec4 cascadeSplits;   // far view depth of each cascade
+    glm::vec4 texelSizes;      // world size of a shadow map texel per cascade, for the normal offset
+    glm::vec4 shadowParams;    // x = cascade count, 0 turns shadows off
+};
+
+struct ShadowCascadeStats {
+    // whether the static casters had to be drawn again this frame
+    bool staticRebuilt = false;
+    double cpuMs = 0.0;
+    // GPU time of the cascade, from a query a frame or two old
+    double gpuMs = 0.0;
+};
+
+struct ShadowStats {
+    ShadowCascadeStats cascades[SHADOW_CASCADE_COUNT];
+    unsigned int staticRebuilds = 0;
+};
+
+// What the caster callbacks draw with: the depth programs of one cascade, with the model
+// matrix going through the upload ring like in the render queue.
+class ShadowPass
+{
+public:
+    unsigned int cascade;
+    // light frustum of the cascade, for culling casters
+    Frustum frustum;
+    // casters left out because the upload ring was full
+    mutable unsigned int dropped = 0;
+
+    ShadowPass(unsigned int cascade, const glm::mat4 &lightViewProjection, UploadRing &ring, Shader &shader, Shader &instancedShader)
+        : cascade(cascade), frustum(lightViewProjection), ring(ring), shader(shader), instancedShader(instancedShader)
+    {
+    }
+
+    void Draw(const Model &model, const glm::mat4 &transform) const
+    {
+        if (!frustum.Intersects(model.bounds.Transform(transform)) || !bindObject(transform))
+            return;
+        for (const Mesh &mesh : model.meshes)
+        {
+            glBindVertexArray(mesh.VAO);
+            glDrawElements(GL_TRIANGLES, mesh.indices.size(), GL_UNSIGNED_INT, 0);
+        }
+    }
+
+    // a non-indexed VAO with the position at location 0
+    void DrawArrays(unsigned int VAO, GLsizei count, const AABB &bounds, const glm::mat4 &transform) const
+    {
+        if (!frustum.Intersects(bounds.Transform(transform)) || !bindObject(transform))
+            return;
+        glBindVertexArray(VAO);
+        glDrawArrays(GL_TRIANGLES, 0, count);
+    }
+
+    void DrawInstanced(Model &model, const InstanceBuffer &instances) const
+    {
+        if (instances.Count() == 0)
+            return;
+        instancedShader.use();
+        for (Mesh &mesh : model.meshes)
+        {
+            mesh.AttachInstances(instances);
+            glBindVertexArray(mesh.VAO);
+            glDrawElementsInstanced(GL_TRIANGLES, mesh.indices.size(), GL_UNSIGNED_INT, 0, instances.Count());
+        }
+    }
+
+    // the VAO has to be attached to its instance buffer already
+    void DrawArraysInstanced(unsigned int VAO, GLsizei count, GLsizei instanceCount) const
+    {
+        if (instanceCount == 0)
+            return;
+        instancedShader.use();
+        glBindVertexArray(VAO);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, count, instanceCount);
+    }
+
+private:
+    UploadRing &ring;
+    Shader &shader;
+    Shader &instancedShader;
+
+    // false when the ring is full, the caster is not drawn then
+    bool bindObject(const glm::mat4 &transform) const
+    {
+        shader.use();
+        if (ring.BindUniform(UNIFORM_BLOCK_OBJECT, &transform, sizeof(glm::mat4)))
+            return true;
+        dropped++;
+        return false;
+    }
+};
+
+// Cascaded shadow maps for the directional light. Every cascade has two layers: static casters are
+// drawn into a cached layer only when it was invalidated, each frame that layer is copied into the
+// sampled one and the dynamic casters are drawn on top of it.
+//
+// To keep the cache valid while the camera moves, a cascade covers a bit more than its part of the
+// view frustum and its center snaps to a grid in light space. The static layer is redrawn when the
+// snapped center or the size changes, when the light turns or when Invalidate() is called.
+class CascadedShadowMaps
+{
+public:
+    static const int SIZE = 1024;
+
+    ShadowStats stats;
+    // draw the casters with the pass, they must not change render targets
+    std::function<void(const ShadowPass &)> drawStatic;
+    std::function<void(const ShadowPass &)> drawDynamic;
+    // draw static casters every frame too, to compare against the cache
+    bool cacheStatic = true;
+
+    CascadedShadowMaps(UploadRing &ring, float shadowDistance = 40.0f)
+        : ring(ring), shadowDistance(shadowDistance),
+          depthShader("resources/shaders/shadow_depth.vs", "resources/shaders/shadow_depth.fs"),
+          instancedDepthShader("resources/shaders/shadow_depth_instanced.vs", "resources/shaders/shadow_depth.fs")
+    {
+        createLayers(staticMaps, staticFramebuffers, false);
+        createLayers(shadowMaps, shadowFramebuffers, true);
+        glGenQueries(2 * SHADOW_CASCADE_COUNT, &queries[0][0]);
+        lightViewProjectionUniform = depthShader.uniform<glm::mat4>("lightViewProjection");
+        instancedLightViewProjectionUniform = instancedDepthShader.uniform<glm::mat4>("lightViewProjection");
+    }
+
+    // static casters moved or were added/removed
+    void Invalidate()
+    {
+        for (Cascade &cascade : cascades)
+            cascade.valid = false;
+    }
+
+    // points the shadow map sampler of a lit program at its texture unit
+    static void SetupShader(Shader &shader)
+    {
+        shader.use();
+        shader.setInt("shadowMap", SHADOW_UNIT_MAP);
+    }
+
+    // renders the cascades for the camera, restores the framebuffer binding and viewport afterwards.
+    // False when the ring had no room for the ShadowData block, which is then not bound
+    bool Update(const glm::mat4 &view, float fov, float aspect, float nearPlane, const glm::vec3 &lightDirection)
+    {
+        stats = ShadowStats();
+        GpuShadowData data;
+        glm::vec3 direction = glm::normalize(lightDirection);
+        if (direction != this->lightDirection)
+        {
+            this->lightDirection = direction;
+            Invalidate();
+        }
+        glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), direction, up);
+        glm::mat4 inverseLightRotation = glm::inverse(lightRotation);
+        glm::mat4 inverseView = glm::inverse(view);
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLint framebuffer;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+        glViewport(0, 0, SIZE, SIZE);
+        glDisable(GL_CULL_FACE);
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+
+        float splitNear = nearPlane;
+        for (unsigned int i = 0; i < SHADOW_CASCADE_COUNT; i++)
+        {
+            std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+            // practical split scheme, a blend of logarithmic and uniform splits
+            float t = (float)(i + 1) / (float)SHADOW_CASCADE_COUNT;
+            float splitFar = 0.75f * nearPlane * std::pow(shadowDistance / nearPlane, t) + 0.25f * (nearPlane + (shadowDistance - nearPlane) * t);
+            Cascade &cascade = cascades[i];
+
+            // bounding sphere of the frustum slice, its radius only depends on the projection
+            glm::vec3 center(0.0f);
+            glm::vec3 corners[8];
+            float tanHalfFov = std::tan(fov * 0.5f);
+            for (int corner = 0; corner < 8; corner++)
+            {
+                float depth = (corner & 4) ? splitFar : splitNear;
+                glm::vec3 viewCorner(((corner & 1) ? 1.0f : -1.0f) * tanHalfFov * aspect * depth,
+                                     ((corner & 2) ? 1.0f : -1.0f) * tanHalfFov * depth, -depth);
+                corners[corner] = glm::vec3(inverseView * glm::vec4(viewCorner, 1.0f));
+                center += corners[corner] / 8.0f;
+            }
+            float radius = 0.0f;
+            for (const glm::vec3 &corner : corners)
+                radius = std::fmax(radius, glm::length(corner - center));
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+
+            // snapping to half the radius moves the sphere at most a quarter radius per axis
+            float grid = radius * 0.5f;
+            float extent = radius + grid * 0.5f;
+            glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+            lightCenter = glm::floor(lightCenter / grid + 0.5f) * grid;
+            if (!cascade.valid || lightCenter != cascade.lightCenter || radius != cascade.radius || !cacheStatic)
+            {
+                cascade.valid = false;
+                cascade.lightCenter = lightCenter;
+                cascade.radius = radius;
+            }
+
+            // casters up to CASTER_DISTANCE towards the light still throw shadows into the cascade
+            glm::vec3 eye = glm::vec3(inverseLightRotation * glm::vec4(lightCenter, 1.0f)) - direction * (extent + CASTER_DISTANCE);
+            glm::mat4 lightView = glm::lookAt(eye, eye + direction, up);
+            glm::mat4 lightProjection = glm::ortho(-extent, extent, -extent, extent, 0.0f, 2.0f * extent + CASTER_DISTANCE);
+            glm::mat4 lightViewProjection = lightProjection * lightView;
+            ShadowPass pass(i, lightViewProjection, ring, depthShader, instancedDepthShader);
+            depthShader.use();
+            depthShader.set(lightViewProjectionUniform, lightViewProjection);
+            instancedDepthShader.use();
+            instancedDepthShader.set(instancedLightViewProjectionUniform, lightViewProjection);
+
+            glBeginQuery(GL_TIME_ELAPSED, queries[queryFrame][i]);
+            if (!cascade.valid)
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, staticFramebuffers[i]);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                if (drawStatic)
+                    drawStatic(pass);
+                // a layer missing casters is drawn again next frame
+                cascade.valid = pass.dropped == 0;
+                stats.cascades[i].staticRebuilt = true;
+                stats.staticRebuilds++;
+            }
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebuffers[i]);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadowFramebuffers[i]);
+            glBlitFramebuffer(0, 0, SIZE, SIZE, 0, 0, SIZE, SIZE, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, shadowFramebuffers[i]);
+            if (drawDynamic)
+                drawDynamic(pass);
+            glEndQuery(GL_TIME_ELAPSED);
+
+            data.lightViewProjections[i] = lightViewProjection;
+            data.cascadeSplits[i] = splitFar;
+            data.texelSizes[i] = 2.0f * extent / (float)SIZE;
+            stats.cascades[i].cpuMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            splitNear = splitFar;
+        }
+        data.cascadeSplits[3] = 0.0f;
+        data.texelSizes[3] = 0.0f;
+        data.shadowParams = glm::vec4((float)SHADOW_CASCADE_COUNT, 0.0f, 0.0f, 0.0f);
+        readQueries();
+
+        glBindVertexArray(0);
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glEnable(GL_CULL_FACE);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+        bool bound = ring.BindUniform(UNIFORM_BLOCK_SHADOWS, &data, sizeof(GpuShadowData));
+        glActiveTexture(GL_TEXTURE0 + SHADOW_UNIT_MAP);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMaps);
+        glActiveTexture(GL_TEXTURE0);
+        return bound;
+    }
+
+private:
+    // how far behind a cascade, towards the light, casters are still drawn
+    static constexpr float CASTER_DISTANCE = 20.0f;
+
+    struct Cascade {
+        bool valid = false;
+        glm::vec3 lightCenter = glm::vec3(0.0f);
+        float radius = 0.0f;
+    };
+
+    UploadRing &ring;
+    float shadowDistance;
+    Shader depthShader;
+    Shader instancedDepthShader;
+    Shader::Uniform<glm::mat4> lightViewProjectionUniform;
+    Shader::Uniform<glm::mat4> instancedLightViewProjectionUniform;
+    glm::vec3 lightDirection = glm::vec3(0.0f);
+    Cascade cascades[SHADOW_CASCADE_COUNT];
+    unsigned int staticMaps = 0, shadowMaps = 0;
+    unsigned int staticFramebuffers[SHADOW_CASCADE_COUNT];
+    unsigned int shadowFramebuffers[SHADOW_CASCADE_COUNT];
+    // two sets of timer queries, one is read while the other is recorded
+    GLuint queries[2][SHADOW_CASCADE_COUNT];
+    unsigned int queryFrame = 0;
+    bool queriesIssued[2] = {false, false};
+    double gpuMs[SHADOW_CASCADE_COUNT] = {0.0};
+
+    // one depth layer and framebuffer per cascade, the sampled array compares depth in the shader
+    void createLayers(unsigned int &texture, unsigned int *framebuffers, bool compare)
+    {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, SIZE, SIZE, SHADOW_CASCADE_COUNT, 0,
+                     GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if (compare)
+        {
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        glGenFramebuffers(SHADOW_CASCADE_COUNT, framebuffers);
+        for (unsigned int i = 0; i < SHADOW_CASCADE_COUNT; i++)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "ERROR::SHADOWS::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // reads last frame's queries if the GPU is done with them, so the timing never stalls
+    void readQueries()
+    {
+        queriesIssued[queryFrame] = true;
+        queryFrame = 1 - queryFrame;
+        if (queriesIssued[queryFrame])
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(queries[queryFrame][SHADOW_CASCADE_COUNT - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                for (unsigned int i = 0; i < SHADOW_CASCADE_COUNT; i++)
+                {
+                    GLuint64 elapsed = 0;
+                    glGetQueryObjectui64v(queries[queryFrame][i], GL_QUERY_RESULT, &elapsed);
+                    gpuMs[i] = (double)elapsed / 1000000.0;
+                }
+            }
+        }
+        for (unsigned int i = 0; i < SHADOW_CASCADE_COUNT; i++)
+            stats.cascades[i].gpuMs = gpuMs[i];
+    }
+};
+
+#endif
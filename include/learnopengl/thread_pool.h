@@ -0,0 +1,115 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads for splitting per-frame CPU work into ranges.
+// ParallelFor blocks until every range is done and the calling thread works too.
+// It is meant to be called from one thread at a time and must not be nested.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int threadCount = std::thread::hardware_concurrency())
+    {
+        // the calling thread is one of the workers
+        for (unsigned int i = 1; i < threadCount; i++)
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned int ThreadCount() const { return workers.size() + 1; }
+
+    // calls body(begin, end) for consecutive ranges of at most grain items covering [0, count)
+    void ParallelFor(unsigned int count, const std::function<void(unsigned int, unsigned int)> &body, unsigned int grain = 1)
+    {
+        if (count == 0)
+            return;
+        grain = std::max(grain, 1u);
+        if (workers.empty() || count <= grain)
+        {
+            body(0, count);
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        job = &body;
+        jobCount = count;
+        jobGrain = grain;
+        next = 0;
+        pending = workers.size();
+        generation++;
+        lock.unlock();
+        wake.notify_all();
+
+        runChunks();
+
+        lock.lock();
+        done.wait(lock, [this]() { return pending == 0; });
+        job = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(unsigned int, unsigned int)> *job = nullptr;
+    unsigned int jobCount = 0;
+    unsigned int jobGrain = 1;
+    std::atomic<unsigned int> next{0};
+    unsigned int pending = 0;
+    unsigned int generation = 0;
+    bool stopping = false;
+
+    void runChunks()
+    {
+        for (;;)
+        {
+            unsigned int begin = next.fetch_add(jobGrain);
+            if (begin >= jobCount)
+                break;
+            (*job)(begin, std::min(begin + jobGrain, jobCount));
+        }
+    }
+
+    void workerLoop()
+    {
+        unsigned int seen = 0;
+        for (;;)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]() { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+            lock.unlock();
+
+            runChunks();
+
+            lock.lock();
+            if (--pending == 0)
+                done.notify_one();
+        }
+    }
+};
+
+#endif
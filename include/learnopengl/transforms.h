@@ -0,0 +1,319 @@
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/upload_ring.h>
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define TRANSFORMS_SSE 1
+#endif
+
+// std140 layout of the ObjectData block, keep in sync with light.vs and texture.vs.
+// The normal matrix only uses its upper 3x3, a mat3 would be padded to three vec4 columns anyway.
+struct GpuObjectData {
+    glm::mat4 model;
+    glm::mat4 normalMatrix;
+};
+
+// general inverse transpose, for matrices that do not come from a TransformSystem
+inline glm::mat4 NormalMatrix(const glm::mat4 &model)
+{
+    return glm::mat4(glm::transpose(glm::inverse(glm::mat3(model))));
+}
+
+// Position, rotation and scale of every object in structure-of-arrays form. Update() rebuilds the
+// world and normal matrices of changed entries four at a time, Upload() writes all of them into the
+// upload ring once per frame so draws only bind their range.
+//
+// local = translate * rotate * scale, the normal matrix is rotate * scale^-1, which is the inverse
+// transpose of the upper 3x3 without a general inverse.
+//
+// Entries can have a parent, which makes the system a scene graph: world = parent world * local.
+// A parent is always created before its children, so the flat arrays are in depth order and one
+// forward pass propagates changes. Entries that did not change and whose parents did not change are
+// skipped, a static subtree costs nothing per frame.
+class TransformSystem
+{
+public:
+    // creates an identity transform, returns its id. parent is -1 or an existing entry
+    unsigned int Create(const glm::vec3 &position = glm::vec3(0.0f), int parent = -1)
+    {
+        unsigned int id = count++;
+        // lanes are allocated in groups of four so the SIMD loop never needs a tail
+        if (id % 4 == 0)
+        {
+            for (std::vector<float> *lane : {&px, &py, &pz, &qx, &qy, &qz, &sx, &sy, &sz})
+                lane->resize(id + 4, 0.0f);
+            qw.resize(id + 4, 1.0f);
+            for (unsigned int i = id; i < id + 4; i++)
+                sx[i] = sy[i] = sz[i] = 1.0f;
+            world.resize(id + 4, glm::mat4(1.0f));
+            normal.resize(id + 4, glm::mat4(1.0f));
+            dirty.resize((id + 4) / 4, 0);
+            offsets.resize(id + 4, -1);
+            parents.resize(id + 4, -1);
+            changed.resize(id + 4, 0);
+        }
+        if (parent >= 0)
+        {
+            if ((unsigned int)parent >= id)
+                std::cout << "ERROR::TRANSFORMS::PARENT_NOT_CREATED_YET" << std::endl;
+            else
+                parents[id] = parent;
+            if (!hierarchy)
+            {
+                // from now on the SIMD pass writes local matrices and Update() propagates them
+                hierarchy = true;
+                local = world;
+                localNormal = normal;
+            }
+        }
+        if (hierarchy)
+        {
+            local.resize(world.size(), glm::mat4(1.0f));
+            localNormal.resize(normal.size(), glm::mat4(1.0f));
+        }
+        SetPosition(id, position);
+        return id;
+    }
+
+    unsigned int Count() const { return count; }
+    int Parent(unsigned int id) const { return parents[id]; }
+
+    void SetPosition(unsigned int id, const glm::vec3 &position)
+    {
+        px[id] = position.x;
+        py[id] = position.y;
+        pz[id] = position.z;
+        markDirty(id);
+    }
+
+    void SetScale(unsigned int id, const glm::vec3 &scale)
+    {
+        sx[id] = scale.x;
+        sy[id] = scale.y;
+        sz[id] = scale.z;
+        markDirty(id);
+    }
+
+    // angle in radians around a unit axis
+    void SetRotation(unsigned int id, float angle, const glm::vec3 &axis)
+    {
+        float s = std::sin(angle * 0.5f);
+        qx[id] = axis.x * s;
+        qy[id] = axis.y * s;
+        qz[id] = axis.z * s;
+        qw[id] = std::cos(angle * 0.5f);
+        markDirty(id);
+    }
+
+    // unit quaternion as (x, y, z, w)
+    void SetOrientation(unsigned int id, const glm::vec4 &quaternion)
+    {
+        qx[id] = quaternion.x;
+        qy[id] = quaternion.y;
+        qz[id] = quaternion.z;
+        qw[id] = quaternion.w;
+        markDirty(id);
+    }
+
+    // rotates further around a unit axis in the object's own frame, like glm::rotate on the matrix
+    void Rotate(unsigned int id, float angle, const glm::vec3 &axis)
+    {
+        float s = std::sin(angle * 0.5f);
+        float bx = axis.x * s, by = axis.y * s, bz = axis.z * s, bw = std::cos(angle * 0.5f);
+        float ax = qx[id], ay = qy[id], az = qz[id], aw = qw[id];
+        qx[id] = aw * bx + ax * bw + ay * bz - az * by;
+        qy[id] = aw * by - ax * bz + ay * bw + az * bx;
+        qz[id] = aw * bz + ax * by - ay * bx + az * bw;
+        qw[id] = aw * bw - ax * bx - ay * by - az * bz;
+        markDirty(id);
+    }
+
+    // everything is rebuilt on the next Update(), e.g. after writing many entries
+    void Invalidate()
+    {
+        for (uint8_t &block : dirty)
+            block = 1;
+        dirtyBlocks = dirty.size();
+    }
+
+    // matrices as of the last Update()
+    const glm::mat4 &World(unsigned int id) const { return world[id]; }
+    const glm::mat4 &Normal(unsigned int id) const { return normal[id]; }
+
+    // rebuilds the matrices of changed entries, returns how many world matrices were recomputed
+    unsigned int Update()
+    {
+        if (dirtyBlocks == 0)
+            return 0;
+        unsigned int updated = 0;
+        unsigned int first = count;
+        for (unsigned int block = 0; block < dirty.size(); block++)
+        {
+            if (!dirty[block])
+                continue;
+            dirty[block] = 0;
+            if (!hierarchy)
+            {
+                updateBlock(block * 4, world, normal);
+                updated += 4;
+                continue;
+            }
+            updateBlock(block * 4, local, localNormal);
+            for (unsigned int i = block * 4; i < block * 4 + 4; i++)
+                changed[i] = 1;
+            if (first == count)
+                first = block * 4;
+        }
+        dirtyBlocks = 0;
+        if (hierarchy)
+            updated = propagate(first);
+        return updated;
+    }
+
+    // writes every object's matrices into the ring, call once per frame before the draws that use Offset()
+    void Upload(UploadRing &ring)
+    {
+        GpuObjectData data;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            data.model = world[i];
+            data.normalMatrix = normal[i];
+            ring.WriteUniform(&data, sizeof(GpuObjectData), offsets[i]);
+        }
+        ring.Flush();
+    }
+
+    // where the object's ObjectData is in the ring this frame, for glBindBufferRange. -1 when the ring
+    // was full, the RenderQueue then writes the matrices of the packet itself
+    GLintptr Offset(unsigned int id) const { return offsets[id]; }
+
+private:
+    unsigned int count = 0;
+    std::vector<float> px, py, pz;
+    std::vector<float> qx, qy, qz, qw;
+    std::vector<float> sx, sy, sz;
+    std::vector<glm::mat4> world;
+    std::vector<glm::mat4> normal;
+    // one flag per block of four entries, the unit Update() works in
+    std::vector<uint8_t> dirty;
+    unsigned int dirtyBlocks = 0;
+    std::vector<GLintptr> offsets;
+    // scene graph, local matrices are only kept once an entry has a parent
+    bool hierarchy = false;
+    std::vector<int> parents;
+    std::vector<glm::mat4> local;
+    std::vector<glm::mat4> localNormal;
+    std::vector<uint8_t> changed;
+
+    // nothing before the first changed entry can be affected, parents come before their children
+    unsigned int propagate(unsigned int first)
+    {
+        unsigned int updated = 0;
+        for (unsigned int i = first; i < count; i++)
+        {
+            int parent = parents[i];
+            if (parent >= 0 && changed[parent])
+                changed[i] = 1;
+            if (!changed[i])
+                continue;
+            if (parent < 0)
+            {
+                world[i] = local[i];
+                normal[i] = localNormal[i];
+            }
+            else
+            {
+                world[i] = world[parent] * local[i];
+                // the inverse transpose of a product is the product of the inverse transposes
+                normal[i] = normal[parent] * localNormal[i];
+            }
+            updated++;
+        }
+        for (unsigned int i = first; i < count; i++)
+            changed[i] = 0;
+        return updated;
+    }
+
+    void markDirty(unsigned int id)
+    {
+        uint8_t &block = dirty[id / 4];
+        if (!block)
+        {
+            block = 1;
+            dirtyBlocks++;
+        }
+    }
+
+#ifdef TRANSFORMS_SSE
+    // columns holds {x, y, z, w} of one matrix column for four entries, stored per entry
+    static void storeColumn(std::vector<glm::mat4> &matrices, unsigned int first, unsigned int column,
+                            __m128 x, __m128 y, __m128 z, __m128 w)
+    {
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        _mm_storeu_ps(&matrices[first][column][0], x);
+        _mm_storeu_ps(&matrices[first + 1][column][0], y);
+        _mm_storeu_ps(&matrices[first + 2][column][0], z);
+        _mm_storeu_ps(&matrices[first + 3][column][0], w);
+    }
+
+    void updateBlock(unsigned int first, std::vector<glm::mat4> &outWorld, std::vector<glm::mat4> &outNormal)
+    {
+        __m128 x = _mm_loadu_ps(&qx[first]), y = _mm_loadu_ps(&qy[first]);
+        __m128 z = _mm_loadu_ps(&qz[first]), w = _mm_loadu_ps(&qw[first]);
+        __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+        __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+        // rotation matrix, rRC = row R, column C
+        __m128 r00 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+        __m128 r10 = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+        __m128 r20 = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+        __m128 r01 = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+        __m128 r11 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+        __m128 r21 = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+        __m128 r02 = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+        __m128 r12 = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+        __m128 r22 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+        __m128 scaleX = _mm_loadu_ps(&sx[first]), scaleY = _mm_loadu_ps(&sy[first]), scaleZ = _mm_loadu_ps(&sz[first]);
+        storeColumn(outWorld, first, 0, _mm_mul_ps(r00, scaleX), _mm_mul_ps(r10, scaleX), _mm_mul_ps(r20, scaleX), zero);
+        storeColumn(outWorld, first, 1, _mm_mul_ps(r01, scaleY), _mm_mul_ps(r11, scaleY), _mm_mul_ps(r21, scaleY), zero);
+        storeColumn(outWorld, first, 2, _mm_mul_ps(r02, scaleZ), _mm_mul_ps(r12, scaleZ), _mm_mul_ps(r22, scaleZ), zero);
+        storeColumn(outWorld, first, 3, _mm_loadu_ps(&px[first]), _mm_loadu_ps(&py[first]), _mm_loadu_ps(&pz[first]), one);
+
+        __m128 inverseX = _mm_div_ps(one, scaleX), inverseY = _mm_div_ps(one, scaleY), inverseZ = _mm_div_ps(one, scaleZ);
+        storeColumn(outNormal, first, 0, _mm_mul_ps(r00, inverseX), _mm_mul_ps(r10, inverseX), _mm_mul_ps(r20, inverseX), zero);
+        storeColumn(outNormal, first, 1, _mm_mul_ps(r01, inverseY), _mm_mul_ps(r11, inverseY), _mm_mul_ps(r21, inverseY), zero);
+        storeColumn(outNormal, first, 2, _mm_mul_ps(r02, inverseZ), _mm_mul_ps(r12, inverseZ), _mm_mul_ps(r22, inverseZ), zero);
+        storeColumn(outNormal, first, 3, zero, zero, zero, one);
+    }
+#else
+    void updateBlock(unsigned int first, std::vector<glm::mat4> &outWorld, std::vector<glm::mat4> &outNormal)
+    {
+        for (unsigned int i = first; i < first + 4; i++)
+        {
+            float x = qx[i], y = qy[i], z = qz[i], w = qw[i];
+            glm::vec3 c0(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y));
+            glm::vec3 c1(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x));
+            glm::vec3 c2(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y));
+            outWorld[i] = glm::mat4(glm::vec4(c0 * sx[i], 0.0f), glm::vec4(c1 * sy[i], 0.0f), glm::vec4(c2 * sz[i], 0.0f),
+                                 glm::vec4(px[i], py[i], pz[i], 1.0f));
+            outNormal[i] = glm::mat4(glm::vec4(c0 / sx[i], 0.0f), glm::vec4(c1 / sy[i], 0.0f), glm::vec4(c2 / sz[i], 0.0f),
+                                  glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        }
+    }
+#endif
+};
+
+#endif
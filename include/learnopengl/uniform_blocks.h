@@ -0,0 +1,25 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+// Uniform blocks shared between programs live at fixed binding points.
+// GLSL 3.30 has no layout(binding = N), so Shader binds every block it finds by name after linking.
+enum UniformBlockBinding {
+    UNIFORM_BLOCK_FRAME = 0,
+    UNIFORM_BLOCK_LIGHTS,
+    UNIFORM_BLOCK_POINT_LIGHTS,
+    UNIFORM_BLOCK_CLUSTERS,
+    UNIFORM_BLOCK_OBJECT,
+    UNIFORM_BLOCK_SHADOWS,
+    UNIFORM_BLOCK_COUNT
+};
+
+static const char *const uniformBlockNames[UNIFORM_BLOCK_COUNT] = {
+    "FrameData",
+    "LightData",
+    "PointLightData",
+    "ClusterData",
+    "ObjectData",
+    "ShadowData"
+};
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef UPLOAD_RING_H
+#define UPLOAD_RING_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_extensions.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// One buffer split into framesInFlight regions that dynamic per-frame data is copied into with memcpy.
+// A fence is placed after each frame, so a region is only written again once the GPU is done
+// reading it, instead of relying on glBufferSubData or orphaning to avoid the stall.
+//
+// With ARB_buffer_storage the buffer is mapped persistently and coherently once. On plain GL 3.3
+// the rest of the current region is mapped unsynchronized on the first write and unmapped on Flush(),
+// since a mapped buffer cannot be drawn from there. Either way, Flush() before drawing with new data.
+//
+// A write that does not fit into the rest of the region fails instead of wrapping over ranges the
+// frame already bound, and the caller has to skip whatever would have read it. The next BeginFrame()
+// then waits for the GPU and recreates the buffer with regions large enough for what the full frame
+// asked for, so only that frame loses draws.
+class UploadRing
+{
+public:
+    unsigned int ID = 0;
+    // frames that had to wait for the GPU before their region could be written
+    unsigned int stalls = 0;
+    // writes that did not fit and times the ring was recreated bigger because of them
+    unsigned int overflows = 0;
+    unsigned int grows = 0;
+
+    UploadRing(GLsizeiptr frameSize, unsigned int framesInFlight = 3)
+        : frameSize(frameSize), fences(framesInFlight, (GLsync)0)
+    {
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+        create();
+    }
+
+    UploadRing(const UploadRing &) = delete;
+    UploadRing &operator=(const UploadRing &) = delete;
+
+    bool Persistent() const { return persistent != nullptr; }
+    GLint UniformAlignment() const { return uniformAlignment; }
+    GLsizeiptr FrameSize() const { return frameSize; }
+
+    // moves to the next region, waiting for the GPU if it still reads the frame that used it last
+    void BeginFrame()
+    {
+        if (demand > frameSize)
+            grow();
+        frame = (frame + 1) % fences.size();
+        cursor = 0;
+        demand = 0;
+        GLsync &fence = fences[frame];
+        if (fence)
+        {
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            {
+                stalls++;
+                while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+                    ;
+            }
+            glDeleteSync(fence);
+            fence = 0;
+        }
+    }
+
+    // reserves size bytes in the current region and returns where to write them, offset is their
+    // position in the buffer for glBindBufferRange. nullptr and offset -1 when the region is full
+    void *Allocate(GLsizeiptr size, GLintptr alignment, GLintptr &offset)
+    {
+        GLintptr start = (cursor + alignment - 1) / alignment * alignment;
+        demand = std::max<GLsizeiptr>(demand, cursor) + (start - cursor) + size;
+        if (start + size > frameSize)
+        {
+            if (overflows++ == 0)
+                std::cout << "ERROR::UPLOAD_RING::FRAME_FULL, growing the ring for the next frame" << std::endl;
+            offset = -1;
+            return nullptr;
+        }
+        cursor = start + size;
+        offset = frame * frameSize + start;
+        if (persistent)
+            return persistent + offset;
+
+        if (!mapped)
+        {
+            // everything after start in this region is unused, the fence keeps the GPU off it
+            glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+            mapped = (char *)glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, frameSize - start,
+                                              GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            mappedOffset = offset;
+        }
+        return mapped + (offset - mappedOffset);
+    }
+
+    // false if the data did not fit, nothing was written then and offset is -1
+    bool Write(const void *data, GLsizeiptr size, GLintptr alignment, GLintptr &offset)
+    {
+        void *destination = Allocate(size, alignment, offset);
+        if (!destination)
+            return false;
+        std::memcpy(destination, data, size);
+        return true;
+    }
+
+    // uniform block data has to start at a multiple of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    bool WriteUniform(const void *data, GLsizeiptr size, GLintptr &offset)
+    {
+        return Write(data, size, uniformAlignment, offset);
+    }
+
+    // writes a uniform block, flushes and binds it to index. On false the binding is left alone and
+    // still points at older data, so nothing that reads the block may be drawn
+    bool BindUniform(GLuint index, const void *data, GLsizeiptr size)
+    {
+        GLintptr offset;
+        if (!WriteUniform(data, size, offset))
+            return false;
+        Flush();
+        glBindBufferRange(GL_UNIFORM_BUFFER, index, ID, offset, size);
+        return true;
+    }
+
+    // makes the writes so far usable by draws, a no-op for the coherent persistent mapping
+    void Flush()
+    {
+        if (!mapped)
+            return;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        mapped = nullptr;
+    }
+
+    // fences the region after the frame's last draw that reads it
+    void EndFrame()
+    {
+        Flush();
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+private:
+    GLsizeiptr frameSize;
+    std::vector<GLsync> fences;
+    GLint uniformAlignment = 256;
+    unsigned int frame = 0;
+    GLintptr cursor = 0;
+    // bytes the current frame asked for, including writes that did not fit
+    GLsizeiptr demand = 0;
+    char *persistent = nullptr;
+    // GL 3.3 path: the currently mapped part of the region
+    char *mapped = nullptr;
+    GLintptr mappedOffset = 0;
+
+    void create()
+    {
+        GLsizeiptr size = frameSize * fences.size();
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+        const GLExtensions &ext = GLExt();
+        if (ext.bufferStorage)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            ext.BufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+            persistent = (char *)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+            if (!persistent)
+                std::cout << "ERROR::UPLOAD_RING::PERSISTENT_MAP_FAILED" << std::endl;
+        }
+        else
+        {
+            glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // waits until the GPU read every region, then replaces the buffer with one that fits the demand
+    void grow()
+    {
+        Flush();
+        for (GLsync &fence : fences)
+        {
+            if (!fence)
+                continue;
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+                ;
+            glDeleteSync(fence);
+            fence = 0;
+        }
+        if (persistent)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            persistent = nullptr;
+        }
+        glDeleteBuffers(1, &ID);
+        // some headroom so a slowly growing frame does not recreate it every time
+        frameSize = std::max(demand + demand / 4, 2 * frameSize);
+        create();
+        grows++;
+    }
+};
+
+#endif
@@ -0,0 +1,29 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// dual Kawase downsample, see BlurChain. texelSize is of the source, which is twice as large
+uniform sampler2D source;
+uniform vec2 texelSize;
+uniform float offset;
+// used part of the source, below 1 only for a scene rendered at dynamic resolution. Taps are kept
+// inside it so the unused border does not bleed in
+uniform vec2 sourceScale;
+
+vec3 Tap(vec2 uv)
+{
+    return texture(source, min(uv, sourceScale - texelSize * 0.5)).rgb;
+}
+
+void main()
+{
+    vec2 uv = TexCoords * sourceScale;
+    vec2 halfTexel = texelSize * 0.5 * offset;
+    vec3 color = Tap(uv) * 4.0;
+    color += Tap(uv - halfTexel);
+    color += Tap(uv + halfTexel);
+    color += Tap(uv + vec2(halfTexel.x, -halfTexel.y));
+    color += Tap(uv - vec2(halfTexel.x, -halfTexel.y));
+    FragColor = vec4(color / 8.0, 1.0);
+}
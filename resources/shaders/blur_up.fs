@@ -0,0 +1,23 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// dual Kawase upsample, see BlurChain. texelSize is of the source, which is half as large
+uniform sampler2D source;
+uniform vec2 texelSize;
+uniform float offset;
+
+void main()
+{
+    vec2 halfTexel = texelSize * 0.5 * offset;
+    vec3 color = texture(source, TexCoords + vec2(-halfTexel.x * 2.0, 0.0)).rgb;
+    color += texture(source, TexCoords + vec2(-halfTexel.x, halfTexel.y)).rgb * 2.0;
+    color += texture(source, TexCoords + vec2(0.0, halfTexel.y * 2.0)).rgb;
+    color += texture(source, TexCoords + vec2(halfTexel.x, halfTexel.y)).rgb * 2.0;
+    color += texture(source, TexCoords + vec2(halfTexel.x * 2.0, 0.0)).rgb;
+    color += texture(source, TexCoords + vec2(halfTexel.x, -halfTexel.y)).rgb * 2.0;
+    color += texture(source, TexCoords + vec2(0.0, -halfTexel.y * 2.0)).rgb;
+    color += texture(source, TexCoords + vec2(-halfTexel.x, -halfTexel.y)).rgb * 2.0;
+    FragColor = vec4(color / 12.0, 1.0);
+}
@@ -0,0 +1,115 @@
+#version 330 core
+// directional light of the deferred path, drawn as a fullscreen quad with framebuffers.vs
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// matches GpuDirLight/GpuPointLight in lights.h
+struct DirLight{
+    vec4 direction;
+
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+};
+
+struct PointLight{
+    vec4 position;  // w = constant
+
+    vec4 ambient;   // w = linear
+    vec4 diffuse;   // w = quadratic
+    vec4 specular;
+};
+
+layout (std140) uniform LightData {
+    DirLight dirLight;
+    int pointLightCount;
+};
+
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 inverseViewProjection;
+    vec4 cameraPosition;
+    float time;
+};
+
+layout (std140) uniform ShadowData {
+    mat4 lightViewProjections[3];
+    vec4 cascadeSplits;  // far view depth of each cascade
+    vec4 texelSizes;     // world size of a shadow map texel per cascade
+    vec4 shadowParams;   // x = cascade count
+};
+
+uniform sampler2DArrayShadow shadowMap;
+
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+// part of the G-buffer that was rendered into, below 1 with dynamic resolution
+uniform vec2 uvScale;
+
+float ShadowFactor(vec3 fragPos, vec3 normal);
+
+vec3 DecodeNormal(vec2 e){
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+// world position from the depth buffer, uv is in the rendered part
+vec3 WorldPosition(vec2 uv){
+    float depth = texture(gDepth, uv * uvScale).r;
+    vec4 world = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    return world.xyz / world.w;
+}
+
+void main(){
+    // nothing was written here, the skybox fills it later
+    vec2 uv = TexCoords * uvScale;
+    if(texture(gDepth, uv).r == 1.0)
+        discard;
+
+    vec3 fragPos = WorldPosition(TexCoords);
+    vec3 normal = DecodeNormal(texture(gNormal, uv).rg);
+    vec4 albedoSpec = texture(gAlbedoSpec, uv);
+
+    // same terms as CalcDirLight in light.fs
+    vec3 lightDir = normalize(dirLight.direction.xyz - fragPos);
+    vec3 viewDir = normalize(cameraPosition.xyz - fragPos);
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float diff = max(dot(normal, lightDir), 0.0);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
+
+    vec3 ambient = dirLight.ambient.rgb * albedoSpec.rgb;
+    vec3 diffuse = dirLight.diffuse.rgb * diff * albedoSpec.rgb;
+    vec3 specular = dirLight.specular.rgb * spec * albedoSpec.a;
+
+    FragColor = vec4(ambient + ShadowFactor(fragPos, normal) * (diffuse + specular), 1.0);
+}
+
+// 1 where the directional light reaches fragPos, 0 in shadow, 3x3 PCF
+float ShadowFactor(vec3 fragPos, vec3 normal){
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    int cascadeCount = int(shadowParams.x);
+    int cascade = 0;
+    while(cascade < cascadeCount && depth > cascadeSplits[cascade])
+        cascade++;
+    if(cascade >= cascadeCount)
+        return 1.0;
+
+    // pushing the lookup out along the normal hides acne without a large depth bias
+    vec4 lightSpace = lightViewProjections[cascade] * vec4(fragPos + normal * texelSizes[cascade] * 1.5, 1.0);
+    vec3 coords = lightSpace.xyz / lightSpace.w * 0.5 + 0.5;
+    if(coords.z > 1.0)
+        return 1.0;
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for(int x = -1; x <= 1; x++)
+        for(int y = -1; y <= 1; y++)
+            lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z - 0.0005));
+    return lit / 9.0;
+}
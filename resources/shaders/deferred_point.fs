@@ -0,0 +1,94 @@
+#version 330 core
+// point light of the deferred path, accumulated over the pixels its volume covers
+out vec4 FragColor;
+
+flat in int LightIndex;
+
+// matches GpuDirLight/GpuPointLight in lights.h
+struct DirLight{
+    vec4 direction;
+
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+};
+
+struct PointLight{
+    vec4 position;  // w = constant
+
+    vec4 ambient;   // w = linear
+    vec4 diffuse;   // w = quadratic
+    vec4 specular;
+};
+
+layout (std140) uniform LightData {
+    DirLight dirLight;
+    int pointLightCount;
+};
+
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 inverseViewProjection;
+    vec4 cameraPosition;
+    float time;
+};
+
+uniform samplerBuffer pointLightData;
+// size of the viewport the lights are drawn into
+uniform vec2 screenSize;
+
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+// part of the G-buffer that was rendered into, below 1 with dynamic resolution
+uniform vec2 uvScale;
+
+vec3 DecodeNormal(vec2 e){
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+// world position from the depth buffer, uv is in the rendered part
+vec3 WorldPosition(vec2 uv){
+    float depth = texture(gDepth, uv * uvScale).r;
+    vec4 world = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    return world.xyz / world.w;
+}
+
+void main(){
+    vec2 screenUV = gl_FragCoord.xy / screenSize;
+    vec2 uv = screenUV * uvScale;
+    if(texture(gDepth, uv).r == 1.0)
+        discard;
+
+    PointLight light;
+    light.position = texelFetch(pointLightData, LightIndex * 4);
+    light.ambient = texelFetch(pointLightData, LightIndex * 4 + 1);
+    light.diffuse = texelFetch(pointLightData, LightIndex * 4 + 2);
+    light.specular = texelFetch(pointLightData, LightIndex * 4 + 3);
+
+    vec3 fragPos = WorldPosition(screenUV);
+    vec3 normal = DecodeNormal(texture(gNormal, uv).rg);
+    vec4 albedoSpec = texture(gAlbedoSpec, uv);
+
+    // same terms as CalcPointLight in light.fs
+    vec3 lightDir = normalize(light.position.xyz - fragPos);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 viewDir = normalize(cameraPosition.xyz - fragPos);
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), 64.0);
+
+    float distance = length(light.position.xyz - fragPos);
+    float attenuation = 1.0 / (light.position.w + light.ambient.w * distance + light.diffuse.w * distance * distance);
+
+    vec3 ambient = light.ambient.rgb * albedoSpec.rgb;
+    vec3 diffuse = light.diffuse.rgb * diff * albedoSpec.rgb;
+    vec3 specular = light.specular.rgb * spec * albedoSpec.a;
+
+    FragColor = vec4((ambient + diffuse + specular) * attenuation, 1.0);
+}
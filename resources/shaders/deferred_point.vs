@@ -0,0 +1,24 @@
+#version 330 core
+// light volume of one point light per instance, sized to the light's radius
+layout (location = 0) in vec3 aPos;
+
+flat out int LightIndex;
+
+uniform samplerBuffer pointLightData;
+
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 inverseViewProjection;
+    vec4 cameraPosition;
+    float time;
+};
+
+void main(){
+    LightIndex = gl_InstanceID;
+    vec4 position = texelFetch(pointLightData, gl_InstanceID * 4);
+    // PointLightRadius from lights.h, computed on the CPU when the lights changed
+    float radius = texelFetch(pointLightData, gl_InstanceID * 4 + 3).w;
+    gl_Position = viewProjection * vec4(position.xyz + aPos * radius, 1.0);
+}
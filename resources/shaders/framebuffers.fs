@@ -3,49 +3,12 @@ out vec4 FragColor;
 
 in vec2 TexCoords;
 
-const float offset = 1.0 / 300.0;
-
-
+// plain copy of the scene to the screen, blurring is done by BlurChain
 uniform sampler2D screenTexture;
-uniform bool blur;
+// part of the texture the scene was rendered into, below 1 with dynamic resolution
+uniform vec2 uvScale;
 
 void main()
 {
-
-if(blur){
-     vec2 offsets[9] = vec2[](
-            vec2(-offset,  offset), // top-left
-            vec2( 0.0f,    offset), // top-center
-            vec2( offset,  offset), // top-right
-            vec2(-offset,  0.0f),   // center-left
-            vec2( 0.0f,    0.0f),   // center-center
-            vec2( offset,  0.0f),   // center-right
-            vec2(-offset, -offset), // bottom-left
-            vec2( 0.0f,   -offset), // bottom-center
-            vec2( offset, -offset)  // bottom-right
-        );
-
-         float kernel[9] = float[](
-              1.0 / 16, 2.0 / 16, 1.0 / 16,
-              2.0 / 16, 4.0 / 16, 2.0 / 16,
-              1.0 / 16, 2.0 / 16, 1.0 / 16
-            );
-
-         vec3 sampleTex[9];
-             for(int i = 0; i < 9; i++)
-             {
-                 sampleTex[i] = vec3(texture(screenTexture, TexCoords.st + offsets[i]));
-             }
-             vec3 col = vec3(0.0);
-             for(int i = 0; i < 9; i++)
-                 col += sampleTex[i] * kernel[i];
-
-         FragColor = vec4(col, 1.0);
-
-
-}
-else{ // normal rendering
-    vec3 col = texture(screenTexture, TexCoords).rgb;
-    FragColor = vec4(col, 1.0);
+    FragColor = vec4(texture(screenTexture, TexCoords * uvScale).rgb, 1.0);
 }
-}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#version 330 core
+// geometry pass of the deferred path, used with light.vs. Variants: HAS_SPECULAR_MAP, HAS_NORMAL_MAP
+layout (location = 0) out vec4 gAlbedoSpec;
+layout (location = 1) out vec2 gNormal;
+
+in vec3 Normal;
+in vec3 FragPos;
+in vec2 TexCoords;
+#ifdef HAS_NORMAL_MAP
+in vec3 Tangent;
+#endif
+
+uniform sampler2D texture_diffuse1;
+#ifdef HAS_SPECULAR_MAP
+uniform sampler2D texture_specular1;
+#endif
+#ifdef HAS_NORMAL_MAP
+uniform sampler2D texture_normal1;
+#endif
+
+// octahedral mapping of a unit vector to [0, 1]^2
+vec2 OctWrap(vec2 v){
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 EncodeNormal(vec3 n){
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    n.xy = n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+    return n.xy * 0.5 + 0.5;
+}
+
+// normal of the surface, bent by the normal map in variants that have one
+vec3 SurfaceNormal(){
+    vec3 normal = normalize(Normal);
+#ifdef HAS_NORMAL_MAP
+    vec3 tangent = normalize(Tangent - dot(Tangent, normal) * normal);
+    vec3 bitangent = cross(normal, tangent);
+    vec3 mapped = texture(texture_normal1, TexCoords).rgb * 2.0 - 1.0;
+    normal = normalize(mat3(tangent, bitangent, normal) * mapped);
+#endif
+    return normal;
+}
+
+// meshes without a specular map get no highlights
+vec3 SpecularMap(){
+#ifdef HAS_SPECULAR_MAP
+    return texture(texture_specular1, TexCoords).rgb;
+#else
+    return vec3(0.0);
+#endif
+}
+
+void main(){
+    gAlbedoSpec.rgb = texture(texture_diffuse1, TexCoords).rgb;
+    gAlbedoSpec.a = SpecularMap().r;
+    gNormal = EncodeNormal(SurfaceNormal());
+}
@@ -3,89 +3,167 @@
 in vec3 Normal;
 in vec3 FragPos;
 in vec2 TexCoords;
-in vec3 viewPos;
+#ifdef HAS_NORMAL_MAP
+in vec3 Tangent;
+#endif
 
 out vec4 FragColor;
 
+// matches GpuDirLight/GpuPointLight in lights.h
 struct DirLight{
-    vec3 direction;
+    vec4 direction;
 
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
 };
 
 struct PointLight{
-    vec3 position;
+    vec4 position;  // w = constant
 
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
+    vec4 ambient;   // w = linear
+    vec4 diffuse;   // w = quadratic
+    vec4 specular;
 };
 
+#define MAX_POINT_LIGHTS 256
+
 uniform sampler2D texture_diffuse1;
+#ifdef HAS_SPECULAR_MAP
 uniform sampler2D texture_specular1;
+#endif
+#ifdef HAS_NORMAL_MAP
+uniform sampler2D texture_normal1;
+#endif
+
+layout (std140) uniform LightData {
+    DirLight dirLight;
+    int pointLightCount;
+};
+
+layout (std140) uniform PointLightData {
+    PointLight pointLights[MAX_POINT_LIGHTS];
+};
+
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 inverseViewProjection;
+    vec4 cameraPosition;
+    float time;
+};
 
-uniform DirLight dirLight;
-uniform PointLight pointLight;
+layout (std140) uniform ShadowData {
+    mat4 lightViewProjections[3];
+    vec4 cascadeSplits;  // far view depth of each cascade
+    vec4 texelSizes;     // world size of a shadow map texel per cascade
+    vec4 shadowParams;   // x = cascade count
+};
 
-//changes
-uniform vec3 viewPosition;
+uniform sampler2DArrayShadow shadowMap;
 
+vec3 SurfaceNormal();
+vec3 SpecularMap();
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+float ShadowFactor(vec3 fragPos, vec3 normal);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
 void main(){
 
-    vec3 norm = normalize(Normal);
-    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 norm = SurfaceNormal();
+    vec3 viewDir = normalize(cameraPosition.xyz - FragPos);
 
     vec3 result = CalcDirLight(dirLight, norm, FragPos, viewDir);
-    result += CalcPointLight(pointLight, norm, FragPos, viewDir);
+    for(int i = 0; i < pointLightCount; i++)
+        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
 
     FragColor = vec4(result, 1.0);
 }
 
+// normal of the surface, bent by the normal map in variants that have one
+vec3 SurfaceNormal(){
+    vec3 normal = normalize(Normal);
+#ifdef HAS_NORMAL_MAP
+    vec3 tangent = normalize(Tangent - dot(Tangent, normal) * normal);
+    vec3 bitangent = cross(normal, tangent);
+    vec3 mapped = texture(texture_normal1, TexCoords).rgb * 2.0 - 1.0;
+    normal = normalize(mat3(tangent, bitangent, normal) * mapped);
+#endif
+    return normal;
+}
+
+// meshes without a specular map get no highlights
+vec3 SpecularMap(){
+#ifdef HAS_SPECULAR_MAP
+    return texture(texture_specular1, TexCoords).rgb;
+#else
+    return vec3(0.0);
+#endif
+}
+
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 fragPos, vec3 viewDir){
-    vec3 lightDir = normalize(light.direction -fragPos);
-    viewDir = normalize(viewPosition - fragPos);
+    vec3 lightDir = normalize(light.direction.xyz -fragPos);
+    viewDir = normalize(cameraPosition.xyz - fragPos);
     vec3 halfwayDir = normalize(lightDir + viewDir);
     float diff = max(dot(normal, lightDir), 0.0);
 
     //vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
 
-    vec3 ambient = light.ambient * vec3(texture(texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(texture_specular1, TexCoords));
+    vec3 ambient = light.ambient.rgb * vec3(texture(texture_diffuse1, TexCoords));
+    vec3 diffuse = light.diffuse.rgb * diff * vec3(texture(texture_diffuse1, TexCoords));
+    vec3 specular = light.specular.rgb * spec * SpecularMap();
 
-    return (ambient + diffuse + specular);
+    return (ambient + ShadowFactor(fragPos, normal) * (diffuse + specular));
 }
 
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir){
-    vec3 lightDir = normalize(light.position - fragPos);
+    vec3 lightDir = normalize(light.position.xyz - fragPos);
     float diff = max(dot(normal, lightDir), 0.0);
 
-    viewDir = normalize(viewPosition - fragPos);
+    viewDir = normalize(cameraPosition.xyz - fragPos);
     vec3 halfwayDir = normalize(lightDir + viewDir);
 
     //vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(normal, halfwayDir), 0.0), 64.0);
 
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+    float constant = light.position.w;
+    float linear = light.ambient.w;
+    float quadratic = light.diffuse.w;
+    float distance = length(light.position.xyz - fragPos);
+    float attenuation = 1.0 / (constant + linear * distance + quadratic * distance * distance);
 
-    vec3 ambient = light.ambient * vec3(texture(texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(texture_specular1, TexCoords));
+    vec3 ambient = light.ambient.rgb * vec3(texture(texture_diffuse1, TexCoords));
+    vec3 diffuse = light.diffuse.rgb * diff * vec3(texture(texture_diffuse1, TexCoords));
+    vec3 specular = light.specular.rgb * spec * SpecularMap();
 
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
 
     return (ambient + diffuse + specular);
-}
\ No newline at end of file
+}
+
+// 1 where the directional light reaches fragPos, 0 in shadow, 3x3 PCF
+float ShadowFactor(vec3 fragPos, vec3 normal){
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    int cascadeCount = int(shadowParams.x);
+    int cascade = 0;
+    while(cascade < cascadeCount && depth > cascadeSplits[cascade])
+        cascade++;
+    if(cascade >= cascadeCount)
+        return 1.0;
+
+    // pushing the lookup out along the normal hides acne without a large depth bias
+    vec4 lightSpace = lightViewProjections[cascade] * vec4(fragPos + normal * texelSizes[cascade] * 1.5, 1.0);
+    vec3 coords = lightSpace.xyz / lightSpace.w * 0.5 + 0.5;
+    if(coords.z > 1.0)
+        return 1.0;
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for(int x = -1; x <= 1; x++)
+        for(int y = -1; y <= 1; y++)
+            lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z - 0.0005));
+    return lit / 9.0;
+}
@@ -1,27 +1,59 @@
 #version 330 core
+// variants: INSTANCED, HAS_NORMAL_MAP, see ShaderPermutations
 
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#ifdef HAS_NORMAL_MAP
+layout (location = 3) in vec3 aTangent;
+#endif
+#ifdef INSTANCED
+// per-instance model matrix, see InstanceBuffer
+layout (location = 5) in mat4 aInstanceModel;
+#endif
 
 out vec3 Normal;
 out vec3 FragPos;
 out vec2 TexCoords;
+#ifdef HAS_NORMAL_MAP
+out vec3 Tangent;
+#endif
 
-out vec3 viewPos;
+#ifndef INSTANCED
+// per-draw data, bound as a range of the upload ring, see GpuObjectData
+layout (std140) uniform ObjectData {
+    mat4 model;
+    // inverse transpose of the upper 3x3, built on the CPU by TransformSystem or RenderQueue
+    mat4 normalMatrix;
+};
+#endif
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform vec3 cameraPos;
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 inverseViewProjection;
+    vec4 cameraPosition;
+    float time;
+};
 
 void main(){
-    viewPos = vec3(0.0f, 2.0f, 10.0f);
-    viewPos = cameraPos;
+#ifdef INSTANCED
+    mat4 world = aInstanceModel;
+    // instances are only rotated and uniformly scaled, the normal is renormalized per fragment
+    mat3 normalTransform = mat3(aInstanceModel);
+#else
+    mat4 world = model;
+    mat3 normalTransform = mat3(normalMatrix);
+#endif
 
     TexCoords = aTexCoords;
-    Normal = mat3(transpose(inverse(model))) * aNormal;
-    FragPos = vec3(model * vec4(aPos, 1.0f));
+    Normal = normalTransform * aNormal;
+#ifdef HAS_NORMAL_MAP
+    // tangents lie in the surface, they follow the model matrix itself
+    Tangent = mat3(world) * aTangent;
+#endif
+    FragPos = vec3(world * vec4(aPos, 1.0f));
 
-    gl_Position = projection * view * vec4(FragPos, 1.0);
-}
\ No newline at end of file
+    gl_Position = viewProjection * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,198 @@
+#version 330 core
+
+in vec3 Normal;
+in vec3 FragPos;
+in vec2 TexCoords;
+#ifdef HAS_NORMAL_MAP
+in vec3 Tangent;
+#endif
+
+out vec4 FragColor;
+
+// light.fs for clustered shading: only the lights assigned to the fragment's cluster are shaded.
+// matches GpuDirLight/GpuPointLight in lights.h
+struct DirLight{
+    vec4 direction;
+
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+};
+
+struct PointLight{
+    vec4 position;  // w = constant
+
+    vec4 ambient;   // w = linear
+    vec4 diffuse;   // w = quadratic
+    vec4 specular;
+};
+
+uniform sampler2D texture_diffuse1;
+#ifdef HAS_SPECULAR_MAP
+uniform sampler2D texture_specular1;
+#endif
+#ifdef HAS_NORMAL_MAP
+uniform sampler2D texture_normal1;
+#endif
+
+layout (std140) uniform LightData {
+    DirLight dirLight;
+    int pointLightCount;
+};
+
+// 4 texels per light, laid out like PointLight
+uniform samplerBuffer pointLightData;
+// (offset, count) into clusterLightIndices for every cluster
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterLightIndices;
+
+// matches GpuClusterData in clusters.h
+layout (std140) uniform ClusterData {
+    uvec4 gridSize;
+    vec4 clusterParams; // tile width, tile height in pixels, slice scale, slice bias
+};
+
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 inverseViewProjection;
+    vec4 cameraPosition;
+    float time;
+};
+
+layout (std140) uniform ShadowData {
+    mat4 lightViewProjections[3];
+    vec4 cascadeSplits;  // far view depth of each cascade
+    vec4 texelSizes;     // world size of a shadow map texel per cascade
+    vec4 shadowParams;   // x = cascade count
+};
+
+uniform sampler2DArrayShadow shadowMap;
+
+vec3 SurfaceNormal();
+vec3 SpecularMap();
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+float ShadowFactor(vec3 fragPos, vec3 normal);
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+PointLight FetchPointLight(int index);
+int ClusterIndex(vec3 fragPos);
+
+void main(){
+
+    vec3 norm = SurfaceNormal();
+    vec3 viewDir = normalize(cameraPosition.xyz - FragPos);
+
+    vec3 result = CalcDirLight(dirLight, norm, FragPos, viewDir);
+    uvec2 lights = texelFetch(clusterGrid, ClusterIndex(FragPos)).rg;
+    for(uint i = 0u; i < lights.y; i++)
+    {
+        int lightIndex = int(texelFetch(clusterLightIndices, int(lights.x + i)).r);
+        result += CalcPointLight(FetchPointLight(lightIndex), norm, FragPos, viewDir);
+    }
+
+    FragColor = vec4(result, 1.0);
+}
+
+// normal of the surface, bent by the normal map in variants that have one
+vec3 SurfaceNormal(){
+    vec3 normal = normalize(Normal);
+#ifdef HAS_NORMAL_MAP
+    vec3 tangent = normalize(Tangent - dot(Tangent, normal) * normal);
+    vec3 bitangent = cross(normal, tangent);
+    vec3 mapped = texture(texture_normal1, TexCoords).rgb * 2.0 - 1.0;
+    normal = normalize(mat3(tangent, bitangent, normal) * mapped);
+#endif
+    return normal;
+}
+
+// meshes without a specular map get no highlights
+vec3 SpecularMap(){
+#ifdef HAS_SPECULAR_MAP
+    return texture(texture_specular1, TexCoords).rgb;
+#else
+    return vec3(0.0);
+#endif
+}
+
+vec3 CalcDirLight(DirLight light, vec3 normal, vec3 fragPos, vec3 viewDir){
+    vec3 lightDir = normalize(light.direction.xyz -fragPos);
+    viewDir = normalize(cameraPosition.xyz - fragPos);
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float diff = max(dot(normal, lightDir), 0.0);
+
+    //vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
+
+    vec3 ambient = light.ambient.rgb * vec3(texture(texture_diffuse1, TexCoords));
+    vec3 diffuse = light.diffuse.rgb * diff * vec3(texture(texture_diffuse1, TexCoords));
+    vec3 specular = light.specular.rgb * spec * SpecularMap();
+
+    return (ambient + ShadowFactor(fragPos, normal) * (diffuse + specular));
+}
+
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir){
+    vec3 lightDir = normalize(light.position.xyz - fragPos);
+    float diff = max(dot(normal, lightDir), 0.0);
+
+    viewDir = normalize(cameraPosition.xyz - fragPos);
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+
+    //vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), 64.0);
+
+    float constant = light.position.w;
+    float linear = light.ambient.w;
+    float quadratic = light.diffuse.w;
+    float distance = length(light.position.xyz - fragPos);
+    float attenuation = 1.0 / (constant + linear * distance + quadratic * distance * distance);
+
+    vec3 ambient = light.ambient.rgb * vec3(texture(texture_diffuse1, TexCoords));
+    vec3 diffuse = light.diffuse.rgb * diff * vec3(texture(texture_diffuse1, TexCoords));
+    vec3 specular = light.specular.rgb * spec * SpecularMap();
+
+    ambient *= attenuation;
+    diffuse *= attenuation;
+    specular *= attenuation;
+
+    return (ambient + diffuse + specular);
+}
+
+PointLight FetchPointLight(int index){
+    PointLight light;
+    light.position = texelFetch(pointLightData, index * 4);
+    light.ambient = texelFetch(pointLightData, index * 4 + 1);
+    light.diffuse = texelFetch(pointLightData, index * 4 + 2);
+    light.specular = texelFetch(pointLightData, index * 4 + 3);
+    return light;
+}
+
+int ClusterIndex(vec3 fragPos){
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    int slice = clamp(int(floor(log(depth) * clusterParams.z + clusterParams.w)), 0, int(gridSize.z) - 1);
+    ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterParams.xy), ivec2(gridSize.xy) - 1);
+    return tile.x + tile.y * int(gridSize.x) + slice * int(gridSize.x * gridSize.y);
+}
+
+// 1 where the directional light reaches fragPos, 0 in shadow, 3x3 PCF
+float ShadowFactor(vec3 fragPos, vec3 normal){
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    int cascadeCount = int(shadowParams.x);
+    int cascade = 0;
+    while(cascade < cascadeCount && depth > cascadeSplits[cascade])
+        cascade++;
+    if(cascade >= cascadeCount)
+        return 1.0;
+
+    // pushing the lookup out along the normal hides acne without a large depth bias
+    vec4 lightSpace = lightViewProjections[cascade] * vec4(fragPos + normal * texelSizes[cascade] * 1.5, 1.0);
+    vec3 coords = lightSpace.xyz / lightSpace.w * 0.5 + 0.5;
+    if(coords.z > 1.0)
+        return 1.0;
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for(int x = -1; x <= 1; x++)
+        for(int y = -1; y <= 1; y++)
+            lit += texture(shadowMap, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z - 0.0005));
+    return lit / 9.0;
+}
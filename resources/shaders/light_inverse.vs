@@ -0,0 +1,33 @@
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec3 Normal;
+out vec3 FragPos;
+out vec2 TexCoords;
+
+// light.vs with the normal matrix computed per vertex, for --normal-matrix-benchmark.
+// The block keeps the same layout so the same ObjectData ranges can be bound.
+layout (std140) uniform ObjectData {
+    mat4 model;
+    mat4 normalMatrix;
+};
+
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 inverseViewProjection;
+    vec4 cameraPosition;
+    float time;
+};
+
+void main(){
+    TexCoords = aTexCoords;
+    Normal = mat3(transpose(inverse(model))) * aNormal;
+    FragPos = vec3(model * vec4(aPos, 1.0f));
+
+    gl_Position = viewProjection * vec4(FragPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// CPU occlusion buffer, 1/w per pixel and 0 where no occluder was drawn
+uniform sampler2D occlusionDepth;
+uniform float nearPlane;
+
+void main()
+{
+    // 1 at the near plane, falling off with distance; sqrt spreads out the far range
+    float depth = clamp(texture(occlusionDepth, TexCoords).r * nearPlane, 0.0, 1.0);
+    FragColor = vec4(vec3(sqrt(depth)), 1.0);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+// depth only pass of the shadow cascades
+layout (location = 0) in vec3 aPos;
+
+layout (std140) uniform ObjectData {
+    mat4 model;
+};
+
+uniform mat4 lightViewProjection;
+
+void main()
+{
+    gl_Position = lightViewProjection * model * vec4(aPos, 1.0);
+}
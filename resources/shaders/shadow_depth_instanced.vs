@@ -0,0 +1,11 @@
+#version 330 core
+// depth only pass of the shadow cascades, model matrix per instance (see InstanceBuffer)
+layout (location = 0) in vec3 aPos;
+layout (location = 5) in mat4 aInstanceModel;
+
+uniform mat4 lightViewProjection;
+
+void main()
+{
+    gl_Position = lightViewProjection * aInstanceModel * vec4(aPos, 1.0);
+}
@@ -8,16 +8,28 @@ out vec3 Normal;
 out vec2 TexCoord;
 
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// per-draw data, bound as a range of the upload ring, see GpuObjectData
+layout (std140) uniform ObjectData {
+    mat4 model;
+    // inverse transpose of the upper 3x3, built on the CPU by TransformSystem or RenderQueue
+    mat4 normalMatrix;
+};
+
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 inverseViewProjection;
+    vec4 cameraPosition;
+    float time;
+};
 
 void main()
 {
     FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    Normal = mat3(normalMatrix) * aNormal;
     TexCoord = aTexCoord;
 
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+    gl_Position = viewProjection * vec4(FragPos, 1.0);
 
 }
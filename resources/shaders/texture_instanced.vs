@@ -0,0 +1,31 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoord;
+// per-instance model matrix, see InstanceBuffer
+layout (location = 5) in mat4 aInstanceModel;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoord;
+
+
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 inverseViewProjection;
+    vec4 cameraPosition;
+    float time;
+};
+
+void main()
+{
+    FragPos = vec3(aInstanceModel * vec4(aPos, 1.0));
+    // instances are only rotated and uniformly scaled, the normal is renormalized per fragment
+    Normal = mat3(aInstanceModel) * aNormal;
+    TexCoord = aTexCoord;
+
+    gl_Position = viewProjection * vec4(FragPos, 1.0);
+
+}
@@ -11,10 +11,41 @@
 
 #include <learnopengl/filesystem.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/shader_permutations.h>
+#include <learnopengl/shader_registry.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
-
+#include <learnopengl/render_queue.h>
+#include <learnopengl/frame_uniforms.h>
+#include <learnopengl/lights.h>
+#include <learnopengl/benchmark.h>
+#include <learnopengl/thread_pool.h>
+#include <learnopengl/clusters.h>
+#include <learnopengl/deferred.h>
+#include <learnopengl/bvh.h>
+#include <learnopengl/instancing.h>
+#include <learnopengl/gl_extensions.h>
+#include <learnopengl/indirect.h>
+#include <learnopengl/upload_ring.h>
+#include <learnopengl/occlusion.h>
+#include <learnopengl/shadows.h>
+#include <learnopengl/transforms.h>
+#include <learnopengl/pets.h>
+#include <learnopengl/blur.h>
+#include <learnopengl/dynamic_resolution.h>
+#include <learnopengl/render_targets.h>
+#include <learnopengl/frame_graph.h>
+#include <learnopengl/gpu_profiler.h>
+
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
 #include <iostream>
+#include <random>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 
@@ -27,6 +58,20 @@ void processInput(GLFWwindow *window);
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
 unsigned int loadCubemap(vector<std::string> faces);
 
+void setBenchmarkLights(LightManager &lights, unsigned int count);
+
+void setStressLights(LightManager &lights, unsigned int count, float time);
+
+bool hasArgument(int argc, char **argv, const std::string &argument);
+
+unsigned int argumentValue(int argc, char **argv, const std::string &argument, unsigned int defaultValue);
+
+void updateLightBVH(BVH &bvh, const LightManager &lights);
+
+void runBVHBenchmark();
+void runTransformBenchmark();
+void runEcsBenchmark(unsigned int count);
+
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
@@ -34,6 +79,32 @@ const unsigned int SCR_HEIGHT = 600;
 bool blur = false;
 bool blurKeyPressed = false;
 
+bool clusteredShading = false;
+bool clusteredKeyPressed = false;
+
+bool deferredShading = false;
+bool deferredKeyPressed = false;
+
+bool pickRequested = false;
+
+bool indirectDraws = false;
+bool indirectKeyPressed = false;
+
+bool occlusionCulling = false;
+bool occlusionKeyPressed = false;
+
+bool occlusionDebug = false;
+bool occlusionDebugKeyPressed = false;
+
+// renderables in the scene BVH
+enum SceneObject {
+    SCENE_STONE = 0,
+    SCENE_DOG,
+    SCENE_STATUE,
+    SCENE_OBJECT_COUNT
+};
+const char *sceneObjectNames[SCENE_OBJECT_COUNT] = {"stone", "dog", "statue"};
+
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 
@@ -41,35 +112,31 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
+// size of the window's framebuffer, the scene targets follow it
+unsigned int framebufferWidth = SCR_WIDTH;
+unsigned int framebufferHeight = SCR_HEIGHT;
+
 // timing
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-//changes
-
-struct PointLight{
-    glm::vec3 position;
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-struct DirLight{
-    glm::vec3 direction;
-
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
-};
-
-//
-
+int main(int argc, char **argv) {
+    // --bvh-benchmark only measures the BVH on the CPU, no window is needed
+    if (hasArgument(argc, argv, "--bvh-benchmark")) {
+        runBVHBenchmark();
+        return 0;
+    }
+    // --transform-benchmark compares TransformSystem with chained glm calls, also CPU only
+    if (hasArgument(argc, argv, "--transform-benchmark")) {
+        runTransformBenchmark();
+        return 0;
+    }
+    // --ecs-benchmark [N] runs the pet behaviours over N entities (1M by default), also CPU only
+    if (hasArgument(argc, argv, "--ecs-benchmark")) {
+        runEcsBenchmark(argumentValue(argc, argv, "--ecs-benchmark", 1000000));
+        return 0;
+    }
 
-int main() {
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -103,6 +170,13 @@ int main() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    LoadGLExtensions((GLADloadproc) glfwGetProcAddress);
+    // differs from the window size on high DPI screens
+    int initialWidth, initialHeight;
+    glfwGetFramebufferSize(window, &initialWidth, &initialHeight);
+    framebuffer_size_callback(window, initialWidth, initialHeight);
+    // --no-shader-cache links every program from source instead of loading shader_cache/
+    GlobalProgramCache().enabled = !hasArgument(argc, argv, "--no-shader-cache");
 
 
 
@@ -113,12 +187,54 @@ int main() {
     glFrontFace(GL_CCW);
 
 
-    //shaders
-    Shader skyboxShader("resources/shaders/skybox.vs", "resources/shaders/skybox.fs");
-    Shader dogShader("resources/shaders/light.vs", "resources/shaders/light.fs");
-    Shader framebuffersShader("resources/shaders/framebuffers.vs","resources/shaders/framebuffers.fs");
-    Shader texShader("resources/shaders/texture.vs", "resources/shaders/texture.fs");
-    Shader statueShader("resources/shaders/light.vs", "resources/shaders/light.fs");
+    //shaders, the same stages and defines asked for twice give the same program
+    ShaderRegistry shaders;
+    // the programs below are only submitted here, the driver compiles them while the buffers,
+    // the cubemap and the models load, FinishBatch() collects them
+    shaders.BeginBatch();
+    Shader &skyboxShader = shaders.Get("resources/shaders/skybox.vs", "resources/shaders/skybox.fs");
+    // a whole model drawn with one program, by the benchmarks. The same program as the lit variant
+    // with a specular map
+    Shader &dogShader = shaders.Get("resources/shaders/light.vs", "resources/shaders/light.fs", "",
+                                    ShaderPermutations::Defines(SHADER_FEATURE_SPECULAR_MAP));
+    Shader &framebuffersShader = shaders.Get("resources/shaders/framebuffers.vs", "resources/shaders/framebuffers.fs");
+    Shader &texShader = shaders.Get("resources/shaders/texture.vs", "resources/shaders/texture.fs");
+    // lit models, every mesh is drawn with the variant its textures need
+    ShaderPermutations litShaders(shaders, "resources/shaders/light.vs", "resources/shaders/light.fs");
+    ShaderPermutations clusteredShaders(shaders, "resources/shaders/light.vs", "resources/shaders/light_clustered.fs");
+    Shader &texInstancedShader = shaders.Get("resources/shaders/texture_instanced.vs", "resources/shaders/texture.fs");
+    Shader &occlusionDebugShader = shaders.Get("resources/shaders/framebuffers.vs", "resources/shaders/occlusion_debug.fs");
+    Shader &uploadUniformShader = shaders.Get("resources/shaders/upload_uniform.vs", "resources/shaders/texture.fs");
+    Shader &inverseNormalShader = shaders.Get("resources/shaders/light_inverse.vs", "resources/shaders/light.fs", "",
+                                              ShaderPermutations::Defines(SHADER_FEATURE_SPECULAR_MAP));
+
+    // --upload-benchmark [N] draws N stones (2000 by default) with the model matrix set by glUniform,
+    // by glBufferSubData into one small uniform buffer and through the upload ring
+    unsigned int uploadBenchmarkCount = 0;
+    if (hasArgument(argc, argv, "--upload-benchmark"))
+        uploadBenchmarkCount = argumentValue(argc, argv, "--upload-benchmark", 2000);
+    // --normal-matrix-benchmark [N] draws N dogs (256 by default) with the normal matrix from the CPU
+    // and with transpose(inverse(model)) per vertex, timing the draws on the GPU
+    unsigned int normalMatrixBenchmarkCount = 0;
+    if (hasArgument(argc, argv, "--normal-matrix-benchmark"))
+        normalMatrixBenchmarkCount = argumentValue(argc, argv, "--normal-matrix-benchmark", 256);
+    // --mdi-benchmark [N] draws N pets (512 by default) with Model::Draw and then through the static batch,
+    // timing only the CPU side of the submission
+    unsigned int mdiBenchmarkCount = 0;
+    if (hasArgument(argc, argv, "--mdi-benchmark"))
+        mdiBenchmarkCount = argumentValue(argc, argv, "--mdi-benchmark", 512);
+
+    // per-frame data (camera, lights, object matrices) is copied into this ring, three frames in flight.
+    // Every benchmark object takes a uniform-aligned slot on top of the scene's own data; a frame that
+    // still asks for more makes the ring grow instead of overwriting what it already bound
+    GLsizeiptr uploadFrameSize = 2 * 1024 * 1024;
+    GLsizeiptr benchmarkObjectCount = (GLsizeiptr)uploadBenchmarkCount + normalMatrixBenchmarkCount + mdiBenchmarkCount;
+    if (benchmarkObjectCount * 256 + 1024 * 1024 > uploadFrameSize)
+        uploadFrameSize = benchmarkObjectCount * 256 + 1024 * 1024;
+    UploadRing uploadRing(uploadFrameSize);
+
+    // camera constants shared by all programs
+    FrameUniforms frameUniforms;
 
     //lights
     PointLight pointLight;
@@ -137,6 +253,51 @@ int main() {
     dirLight.diffuse = glm::vec3 (0.5f, 0.5f, 0.5f);
     dirLight.specular = glm::vec3 (0.5f, 0.5f, 0.5f);
 
+    // light data is rebuilt only when something changed and written to the upload ring every frame
+    LightManager lightManager;
+    lightManager.SetDirLight(dirLight);
+    lightManager.AddPointLight(pointLight);
+
+    // --light-benchmark renders the scene with 1 to 256 point lights and prints frame times
+    FrameBenchmark lightBenchmark("point light");
+    std::vector<unsigned int> benchmarkLightCounts;
+    if (hasArgument(argc, argv, "--light-benchmark")) {
+        for (unsigned int count = 1; count <= LightManager::MAX_POINT_LIGHTS; count *= 2) {
+            benchmarkLightCounts.push_back(count);
+            lightBenchmark.AddStep(std::to_string(count));
+        }
+        setBenchmarkLights(lightManager, benchmarkLightCounts[0]);
+        glfwSwapInterval(0);
+    }
+
+    // lights are assigned to view frustum clusters on the worker threads
+    ThreadPool threadPool;
+    ClusteredLighting clusteredLighting(threadPool);
+    litShaders.setup = [](Shader &shader) {
+        CascadedShadowMaps::SetupShader(shader);
+    };
+    clusteredShaders.setup = [&clusteredLighting](Shader &shader) {
+        CascadedShadowMaps::SetupShader(shader);
+        clusteredLighting.SetupShader(shader);
+    };
+    // the static batch draws every mesh with one program, so it takes the variant with all of the textures
+    Shader &dogInstancedShader = litShaders.Get(SHADER_FEATURE_SPECULAR_MAP | SHADER_FEATURE_INSTANCED);
+    Shader &clusteredInstancedShader = clusteredShaders.Get(SHADER_FEATURE_SPECULAR_MAP | SHADER_FEATURE_INSTANCED);
+
+    // --cluster-stress [N] moves N point lights (4096 by default) around the pets with clustered shading on
+    unsigned int stressLightCount = 0;
+    if (hasArgument(argc, argv, "--cluster-stress")) {
+        stressLightCount = argumentValue(argc, argv, "--cluster-stress", 4096);
+        // the light buffer has room for this many, LightManager refuses the rest
+        if (stressLightCount > LightManager::MAX_CLUSTERED_POINT_LIGHTS) {
+            std::cout << "WARNING::CLUSTER_STRESS: " << stressLightCount << " lights requested, using "
+                      << LightManager::MAX_CLUSTERED_POINT_LIGHTS << std::endl;
+            stressLightCount = LightManager::MAX_CLUSTERED_POINT_LIGHTS;
+        }
+        clusteredShading = true;
+        glfwSwapInterval(0);
+    }
+
     //
     float skyboxVertices[] = {
             // positions
@@ -315,32 +476,31 @@ int main() {
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
 
 
-    framebuffersShader.use();
-    framebuffersShader.setInt("screenTexture",0);
+    // every texture the frame renders into, taken per frame at the current window size
+    RenderTargetPool renderTargets;
 
+    // Space blurs the whole picture, --blur-radius [R] sets how far in pixels (8 by default)
+    BlurChain blurChain(renderTargets, quadVAO);
+    blurChain.radius = (float)argumentValue(argc, argv, "--blur-radius", 8);
 
-    unsigned int framebuffer;
-    glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-
-    unsigned int textureColorbuffer;
-    glGenTextures(1, &textureColorbuffer);
-    glBindTexture(GL_TEXTURE_2D, textureColorbuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureColorbuffer, 0);
 
-    unsigned int rbo;
-    glGenRenderbuffers(1, &rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
+    // the frame's passes and the targets between them, declared again every frame
+    FrameGraph frameGraph(renderTargets);
+    // GPU time of every frame graph pass and of a few scopes inside them, printed every second.
+    // --gpu-profile writes the numbers to gpu_profile.csv and gpu_profile.json on exit
+    GpuProfiler gpuProfiler;
+    frameGraph.profiler = &gpuProfiler;
+    bool gpuProfileDump = hasArgument(argc, argv, "--gpu-profile");
+    // what the scene pass draws into, the deferred resolve writes there too
+    unsigned int framebuffer = 0;
 
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        cout << "ERROR: Framebuffer is not complete!" << endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // --dynamic-resolution [FPS] renders the scene into a smaller part of the framebuffer whenever
+    // the GPU takes longer than a frame at FPS (60 by default), the composite pass scales it back up
+    DynamicResolution dynamicResolution(framebufferWidth, framebufferHeight);
+    bool dynamicResolutionEnabled = hasArgument(argc, argv, "--dynamic-resolution");
+    if (dynamicResolutionEnabled)
+        dynamicResolution.targetMs = 1000.0 / std::max(argumentValue(argc, argv, "--dynamic-resolution", 60), 1u);
+    unsigned int renderWidth = framebufferWidth, renderHeight = framebufferHeight;
 
     vector<std::string> faces
             {
@@ -359,6 +519,250 @@ int main() {
     Model dogModel("resources/objects/dog/source/dog.fbx");
     Model statueModel("resources/objects/wooden-statue-of-the-owl/source/drevena_sova_ratibor/drevena_sova_ratibor.FBX");
 
+    // the variants the models are drawn with go into the batch too instead of linking on first use
+    for (Model *model : {&dogModel, &statueModel}) {
+        model->RequestShaders(litShaders);
+        model->RequestShaders(clusteredShaders);
+    }
+
+    // every program submitted above is usable from here on
+    shaders.FinishBatch();
+    framebuffersShader.use();
+    framebuffersShader.setInt("screenTexture",0);
+    Shader::Uniform<glm::vec2> framebuffersUvScale = framebuffersShader.uniform<glm::vec2>("uvScale");
+    framebuffersShader.set(framebuffersUvScale, glm::vec2(1.0f));
+
+    RenderQueue renderQueue(uploadRing);
+    // the stone block spans [-1, 1] x [-0.1, 0.1] x [-1, 1], see stoneVertices
+    AABB stoneBounds(glm::vec3(-1.0f, -0.1f, -1.0f), glm::vec3(1.0f, 0.1f, 1.0f));
+    unsigned int stoneMaterial = renderQueue.RegisterMaterial({{GL_TEXTURE_2D, texture, "texture1"}});
+    unsigned int skyboxMaterial = renderQueue.RegisterMaterial({{GL_TEXTURE_CUBE_MAP, cubemapTexture, "skybox"}});
+    // skybox is drawn last, behind everything already in the depth buffer
+    renderQueue.passBegin[RENDER_PASS_SKYBOX] = [&gpuProfiler]() {
+        gpuProfiler.Begin("skybox");
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_LEQUAL);
+    };
+    renderQueue.passEnd[RENDER_PASS_SKYBOX] = [&gpuProfiler]() {
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        gpuProfiler.End();
+    };
+    float statsTimer = 0.0f;
+
+    // scene graph of the static objects, the models bring their node hierarchy along. World and normal
+    // matrices are uploaded once per frame, subtrees that do not move are not recomputed
+    TransformSystem sceneTransforms;
+    unsigned int stoneTransform = sceneTransforms.Create(glm::vec3(0.95f, -0.5f, 0.1f));
+    sceneTransforms.SetRotation(stoneTransform, glm::radians(10.0f), glm::normalize(glm::vec3(1.0f, 0.2f, 0.3f)));
+    sceneTransforms.SetScale(stoneTransform, glm::vec3(0.45f));
+
+    unsigned int dogTransform = dogModel.AddNodes(sceneTransforms);
+    sceneTransforms.SetPosition(dogTransform, glm::vec3(-0.25f, -1.0f, 0.0f));
+    sceneTransforms.SetScale(dogTransform, glm::vec3(0.01f));
+    sceneTransforms.SetRotation(dogTransform, glm::radians(60.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+
+    unsigned int statueTransform = statueModel.AddNodes(sceneTransforms);
+    sceneTransforms.SetPosition(statueTransform, glm::vec3(0.8f, 0.2f, 0.5f));
+    sceneTransforms.SetScale(statueTransform, glm::vec3(0.07f));
+    sceneTransforms.SetRotation(statueTransform, glm::radians(260.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+    sceneTransforms.Rotate(statueTransform, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    sceneTransforms.Update();
+
+    // no transforms are created after this, so the references stay valid
+    const glm::mat4 &model1 = sceneTransforms.World(stoneTransform);
+    const glm::mat4 &model = sceneTransforms.World(dogTransform);
+    const glm::mat4 &model2 = sceneTransforms.World(statueTransform);
+
+    // the scene BVH answers culling and picking, the light BVH prefilters lights for clustering
+    BVH sceneBVH;
+    sceneBVH.Add(stoneBounds.Transform(model1), SCENE_STONE);
+    sceneBVH.Add(dogModel.bounds.Transform(model), SCENE_DOG);
+    sceneBVH.Add(statueModel.bounds.Transform(model2), SCENE_STATUE);
+    BVH lightBVH;
+    std::vector<unsigned int> visibleObjects;
+    std::vector<unsigned int> candidateLights;
+
+    // --dog-yard [N] puts N dogs (1024 by default) on stone slabs behind the scene, drawn instanced
+    std::vector<glm::mat4> yardDogs, yardStones;
+    if (hasArgument(argc, argv, "--dog-yard")) {
+        unsigned int yardSize = argumentValue(argc, argv, "--dog-yard", 1024);
+        unsigned int columns = (unsigned int)std::ceil(std::sqrt((float)yardSize));
+        for (unsigned int i = 0; i < yardSize; i++) {
+            glm::vec3 position((float)(i % columns) * 1.5f - columns * 0.75f, -1.0f, -4.0f - (float)(i / columns) * 1.5f);
+            glm::mat4 dog = glm::translate(glm::mat4(1.0f), position);
+            dog = glm::scale(dog, glm::vec3(0.01f));
+            dog = glm::rotate(dog, glm::radians((float)((i * 37) % 360)), glm::vec3(0.0f, -1.0f, 0.0f));
+            yardDogs.push_back(dog);
+            glm::mat4 stone = glm::translate(glm::mat4(1.0f), position - glm::vec3(0.0f, 0.06f, 0.0f));
+            yardStones.push_back(glm::scale(stone, glm::vec3(0.6f)));
+        }
+        glfwSwapInterval(0);
+    }
+    InstanceBuffer yardDogInstances, yardStoneInstances;
+    // the stone VAO is not a Mesh, so it is pointed at its instance buffer once here
+    if (!yardStones.empty()) {
+        yardStoneInstances.Upload(yardStones);
+        yardStoneInstances.Attach(VAO);
+    }
+    std::vector<glm::mat4> visibleYardDogs, visibleYardStones;
+
+    // --pets [N] lets N dogs (2000 by default) wander around the yard as entities, with an owl statue
+    // for every 16 of them. They go through the same instanced draws as the yard dogs
+    PetSimulation pets;
+    if (hasArgument(argc, argv, "--pets")) {
+        unsigned int petCount = argumentValue(argc, argv, "--pets", 2000);
+        unsigned int columns = (unsigned int)std::ceil(std::sqrt((float)petCount));
+        Renderable dog = {&dogModel, dogModel.sphere};
+        Renderable owl = {&statueModel, statueModel.sphere};
+        // the statue in the scene is turned over the same way
+        glm::mat4 owlOrientation = glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        for (unsigned int i = 0; i < petCount; i++) {
+            glm::vec3 home((float)(i % columns) * 2.0f - columns, -1.0f, -6.0f - (float)(i / columns) * 2.0f);
+            pets.SpawnPet(dog, home, 0.01f, i * 2654435761u);
+            if (i % 16 == 0)
+                pets.SpawnProp(owl, home + glm::vec3(1.0f, 1.2f, 1.0f), (float)i, 0.07f, owlOrientation);
+        }
+    }
+    InstanceBuffer petPropInstances;
+    std::vector<glm::mat4> visiblePetProps;
+
+    // the stone and the pets are rasterized on the CPU as occluders, O culls whatever they hide
+    OcclusionCuller occlusion;
+    unsigned int stoneOccluder = occlusion.AddOccluder(stoneVertices, 36, 8);
+    unsigned int dogOccluder = occlusion.AddOccluder(dogModel);
+    unsigned int statueOccluder = occlusion.AddOccluder(statueModel);
+    occlusionDebugShader.use();
+    occlusionDebugShader.setInt("occlusionDepth", 0);
+    occlusionDebugShader.setFloat("nearPlane", 1.1f);
+
+    // static models merged for multi-draw indirect, M switches the pets and the yard over to it
+    StaticBatch staticBatch;
+    unsigned int dogBatchObject = staticBatch.AddModel(dogModel);
+    unsigned int statueBatchObject = staticBatch.AddModel(statueModel);
+    staticBatch.Build();
+
+    // the --mdi-benchmark pets
+    FrameBenchmark mdiBenchmark("static draw");
+    std::vector<glm::mat4> benchmarkDogs, benchmarkStatues;
+    std::vector<GpuObjectData> benchmarkObjects;
+    std::vector<GLintptr> benchmarkOffsets;
+    if (mdiBenchmarkCount > 0) {
+        unsigned int columns = (unsigned int)std::ceil(std::sqrt((float)mdiBenchmarkCount));
+        for (unsigned int i = 0; i < mdiBenchmarkCount; i++) {
+            glm::vec3 position((float)(i % columns) * 1.5f - columns * 0.75f, -1.0f, -4.0f - (float)(i / columns) * 1.5f);
+            glm::mat4 transform = glm::translate(glm::mat4(1.0f), position);
+            if (i % 2 == 0) {
+                benchmarkDogs.push_back(glm::scale(transform, glm::vec3(0.01f)));
+            } else {
+                transform = glm::scale(transform, glm::vec3(0.07f));
+                benchmarkStatues.push_back(glm::rotate(transform, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+            }
+        }
+        for (const glm::mat4 &dog : benchmarkDogs)
+            benchmarkObjects.push_back({dog, NormalMatrix(dog)});
+        for (const glm::mat4 &statue : benchmarkStatues)
+            benchmarkObjects.push_back({statue, NormalMatrix(statue)});
+        mdiBenchmark.AddStep("Model::Draw");
+        mdiBenchmark.AddStep(GLExt().multiDrawIndirect ? "multi-draw" : "base-vertex");
+        glfwSwapInterval(0);
+    }
+
+    FrameBenchmark uploadBenchmark("object upload");
+    std::vector<GpuObjectData> uploadStones;
+    std::vector<GLintptr> uploadOffsets;
+    Shader::Uniform<glm::mat4> uploadUniformModel = uploadUniformShader.uniform<glm::mat4>("model");
+    unsigned int objectUBO = 0;
+    if (uploadBenchmarkCount > 0) {
+        unsigned int columns = (unsigned int)std::ceil(std::sqrt((float)uploadBenchmarkCount));
+        for (unsigned int i = 0; i < uploadBenchmarkCount; i++) {
+            glm::vec3 position((float)(i % columns) * 0.5f - columns * 0.25f, -1.5f, -2.0f - (float)(i / columns) * 0.5f);
+            glm::mat4 stone = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(0.2f));
+            uploadStones.push_back({stone, NormalMatrix(stone)});
+        }
+        glGenBuffers(1, &objectUBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, objectUBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(GpuObjectData), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        uploadBenchmark.AddStep("glUniform");
+        uploadBenchmark.AddStep("glBufferSubData");
+        uploadBenchmark.AddStep(uploadRing.Persistent() ? "ring" : "ring (map)");
+        glfwSwapInterval(0);
+    }
+
+    // cascaded shadows of the directional light. The stone and the statue never move, so they stay in the
+    // cached static layer; the dogs are treated as dynamic and drawn every frame
+    CascadedShadowMaps shadows(uploadRing);
+    shadows.cacheStatic = !hasArgument(argc, argv, "--no-shadow-cache");
+    CascadedShadowMaps::SetupShader(dogShader);
+    // the yard dogs throw shadows whether or not they are in view
+    InstanceBuffer yardDogShadowInstances;
+    yardDogShadowInstances.Upload(yardDogs);
+    shadows.drawStatic = [&](const ShadowPass &pass) {
+        pass.DrawArrays(VAO, 36, stoneBounds, model1);
+        pass.Draw(statueModel, model2);
+    };
+    shadows.drawDynamic = [&](const ShadowPass &pass) {
+        pass.Draw(dogModel, model);
+        if (!yardDogs.empty())
+            pass.DrawInstanced(dogModel, yardDogShadowInstances);
+    };
+
+    FrameBenchmark normalMatrixBenchmark("normal matrix");
+    CascadedShadowMaps::SetupShader(inverseNormalShader);
+    TransformSystem benchmarkTransforms;
+    unsigned int normalMatrixQueries[2] = {0, 0};
+    unsigned int normalMatrixFrame = 0;
+    if (normalMatrixBenchmarkCount > 0) {
+        unsigned int columns = (unsigned int)std::ceil(std::sqrt((float)normalMatrixBenchmarkCount));
+        for (unsigned int i = 0; i < normalMatrixBenchmarkCount; i++) {
+            unsigned int dog = benchmarkTransforms.Create(glm::vec3((float)(i % columns) * 1.5f - columns * 0.75f, -1.0f,
+                                                                    -4.0f - (float)(i / columns) * 1.5f));
+            benchmarkTransforms.SetScale(dog, glm::vec3(0.01f));
+            benchmarkTransforms.SetRotation(dog, glm::radians((float)((i * 37) % 360)), glm::vec3(0.0f, -1.0f, 0.0f));
+        }
+        benchmarkTransforms.Update();
+        glGenQueries(2, normalMatrixQueries);
+        normalMatrixBenchmark.AddStep("cpu");
+        normalMatrixBenchmark.AddStep("inverse");
+        glfwSwapInterval(0);
+    }
+
+    // deferred path: lit models go to the G-buffer, which is resolved into the scene framebuffer
+    // before the forward-shaded stone and the skybox are drawn
+    DeferredRenderer deferredRenderer(renderTargets, shaders, framebufferWidth, framebufferHeight, quadVAO);
+    dogModel.RequestShaders(deferredRenderer.geometryShaders);
+    statueModel.RequestShaders(deferredRenderer.geometryShaders);
+    deferredShading = hasArgument(argc, argv, "--deferred");
+    renderQueue.passBegin[RENDER_PASS_GEOMETRY] = [&]() {
+        gpuProfiler.Begin("deferred");
+        deferredRenderer.BeginGeometry();
+    };
+    renderQueue.passEnd[RENDER_PASS_GEOMETRY] = [&]() {
+        deferredRenderer.Resolve(framebuffer, lightManager);
+        gpuProfiler.End();
+    };
+
+    {
+        // warm when the programs came from the cache a previous run left behind
+        const ProgramCacheStats &programs = GlobalProgramCache().stats;
+        const ShaderRegistryStats &registry = shaders.stats;
+        std::cout << "shader registry: " << registry.programs << " programs for " << registry.requests << " requests, "
+                  << registry.shared << " shared, " << registry.savedMs << " ms of compiling and linking saved" << std::endl;
+        std::cout << "shader batch: " << registry.batched << " programs compiled alongside " << registry.batchOverlapMs
+                  << " ms of loading, " << registry.batchWaitMs << " ms waited for them afterwards"
+                  << (GLExt().parallelShaderCompile ? " (parallel shader compile)" : "") << std::endl;
+        std::cout << "shader programs: " << programs.programs << " created in " << programs.totalMs << " ms, "
+                  << programs.loaded << " from cache, " << programs.compiled << " compiled, " << programs.stored
+                  << " stored";
+        if (!GlobalProgramCache().Active())
+            std::cout << " (cache off)";
+        else if (programs.rejected > 0)
+            std::cout << " (" << programs.rejected << " cached binaries rejected)";
+        else
+            std::cout << (programs.compiled == 0 ? " (warm)" : " (cold)");
+        std::cout << std::endl;
+    }
 
 
 
@@ -374,161 +778,406 @@ int main() {
         // -----
         processInput(window);
 
-
-        glBindFramebuffer(GL_FRAMEBUFFER,framebuffer);
-        glEnable(GL_DEPTH_TEST);
-
-
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-
-        glBindTexture(GL_TEXTURE_2D,texture);
-
-
-
-        texShader.use();
-
-        glm::mat4 model1 = glm::mat4(1.0f);
-        glm::mat4 view1 = camera.GetViewMatrix();
-        glm::mat4 projection1 = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 1.1f, 100.0f);
-
-        texShader.setMat4("projection", projection1);
-        texShader.setMat4("view",view1);
-
-
-
-        model1=glm::translate(model1,glm::vec3(0.95f, -0.5f, 0.1f));
-        model1=glm::rotate(model1, glm::radians(10.0f), glm::vec3(1.0f, 0.2f, 0.3f));
-        model1 = glm::scale(model1, glm::vec3(0.45f));
-        texShader.setMat4("model", model1);
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-
-
-
-
-
-
-
-
-        dogShader.use();
-
-
-        dogShader.setVec3("pointLight.position", pointLight.position);
-        dogShader.setVec3("pointLight.ambient", pointLight.ambient);
-        dogShader.setVec3("pointLight.diffuse", pointLight.diffuse);
-        dogShader.setVec3("pointLight.specular", pointLight.specular);
-
-        dogShader.setFloat("pointLight.constant", pointLight.constant);
-        dogShader.setFloat("pointLight.linear", pointLight.linear);
-        dogShader.setFloat("pointLight.quadratic", pointLight.quadratic);
-
-        dogShader.setVec3("viewPosition", camera.Position);
-
-
-        dogShader.setVec3("dirLight.direction", dirLight.direction);
-        dogShader.setVec3("dirLight.ambient", dirLight.ambient);
-        dogShader.setVec3("dirLight.diffuse", dirLight.diffuse);
-        dogShader.setVec3("dirLight.specular", dirLight.specular);
-        //
-
+        if (lightBenchmark.Running()) {
+            if (lightBenchmark.Frame(deltaTime * 1000.0))
+                setBenchmarkLights(lightManager, benchmarkLightCounts[lightBenchmark.Step()]);
+            if (!lightBenchmark.Running())
+                glfwSetWindowShouldClose(window, true);
+        }
 
 
+        // the scene targets are asked for at the window size, after a resize the pool creates new
+        // ones and frees the old ones a few frames later
+        renderTargets.BeginFrame();
+        gpuProfiler.BeginFrame();
+        frameGraph.Reset();
+        unsigned int sceneWidth = framebufferWidth, sceneHeight = framebufferHeight;
+        FrameResource sceneColor = frameGraph.Create("scene color", {sceneWidth, sceneHeight, GL_RGB8}, true,
+                                                     glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
+        FrameResource sceneDepth = frameGraph.Create("scene depth", {sceneWidth, sceneHeight, GL_DEPTH24_STENCIL8, 1, GL_NEAREST}, true);
+        FrameResource backbuffer = frameGraph.ImportBackbuffer("backbuffer", sceneWidth, sceneHeight);
+        deferredRenderer.Resize(sceneWidth, sceneHeight);
+        dynamicResolution.Resize(sceneWidth, sceneHeight);
+
+        renderWidth = sceneWidth;
+        renderHeight = sceneHeight;
+        glm::vec2 sceneUvScale(1.0f);
+        if (dynamicResolutionEnabled) {
+            dynamicResolution.BeginFrame();
+            renderWidth = dynamicResolution.Width();
+            renderHeight = dynamicResolution.Height();
+            sceneUvScale = dynamicResolution.UvScale();
+        }
+        deferredRenderer.SetRenderSize(renderWidth, renderHeight);
 
-        glm::mat4 model = glm::mat4(1.0f);
         glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 1.1f, 100.0f);
-
-        model = glm::translate(model, glm::vec3(-0.25f,-1.0f,0.0f));
-        model = glm::scale(model, glm::vec3(0.01f));
-        model=glm::rotate(model,glm::radians(60.0f),glm::vec3(0.0f,-1.0f,0.0f));
-
-
-
-        dogShader.setMat4("projection", projection);
-        dogShader.setMat4("view", view);
-
-        dogShader.setMat4("model", model);
-        dogModel.Draw(dogShader);
-
-
-        //CHANGE
-        statueShader.use();
-
-
-        statueShader.setVec3("pointLight.position", pointLight.position);
-        statueShader.setVec3("pointLight.ambient", pointLight.ambient);
-        statueShader.setVec3("pointLight.diffuse", pointLight.diffuse);
-        statueShader.setVec3("pointLight.specular", pointLight.specular);
-
-        statueShader.setFloat("pointLight.constant", pointLight.constant);
-        statueShader.setFloat("pointLight.linear", pointLight.linear);
-        statueShader.setFloat("pointLight.quadratic", pointLight.quadratic);
-
-        statueShader.setVec3("viewPosition", camera.Position);
-
-
-        statueShader.setVec3("dirLight.direction", dirLight.direction);
-        statueShader.setVec3("dirLight.ambient", dirLight.ambient);
-        statueShader.setVec3("dirLight.diffuse", dirLight.diffuse);
-        statueShader.setVec3("dirLight.specular", dirLight.specular);
-
-
-
-
-
-        glm::mat4 model2 = glm::mat4(1.0f);
-        glm::mat4 view2 = camera.GetViewMatrix();
-        glm::mat4 projection2 = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 1.1f, 100.0f);
-        //projection2 = glm::scale(projection2, glm::vec3(1.0f, -1.0f, 1.0f));
-        model2 = glm::translate(model2, glm::vec3(0.8f, 0.2f, 0.5f));
-        model2 = glm::scale(model2, glm::vec3(0.07f));
-        model2=glm::rotate(model2,glm::radians(260.0f),glm::vec3(0.0f,-1.0f,0.0f));
-        model2=glm::rotate(model2,glm::radians(180.0f),glm::vec3(0.0f,0.0f,1.0f));
-
-        statueShader.setMat4("projection", projection2);
-        statueShader.setMat4("view", view2);
-
-
-        statueShader.setMat4("model", model2);
-
-
-        statueModel.Draw(statueShader);
-
-        //
-
-        // draw skybox as last
-        glDepthMask(GL_FALSE);
-        glDepthFunc(GL_LEQUAL);
-        skyboxShader.use();
-        skyboxShader.setInt("skybox", 0);
-
-        skyboxShader.setMat4("view", glm::mat4 (glm::mat3(view)));
-        skyboxShader.setMat4("projection", projection);
-
-
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)sceneWidth / (float)sceneHeight, 1.1f, 100.0f);
+
+        // per-frame uniforms, per-object ones are set by the render queue. If the ring has no room for
+        // one of the shared blocks its binding still points at older data, so the scene is not drawn
+        uploadRing.BeginFrame();
+        bool frameDataBound = frameUniforms.Update(uploadRing, view, projection, camera.Position, currentFrame);
+        Frustum frustum(projection * view);
+
+        if (stressLightCount > 0)
+            setStressLights(lightManager, stressLightCount, currentFrame);
+        frameDataBound = lightManager.Upload(uploadRing) && frameDataBound;
+        sceneTransforms.Update();
+        sceneTransforms.Upload(uploadRing);
+        {
+            GpuScope scope(gpuProfiler, "shadows");
+            frameDataBound = shadows.Update(view, glm::radians(camera.Zoom), (float)sceneWidth / (float)sceneHeight, 1.1f,
+                                            lightManager.GetDirLight().direction) && frameDataBound;
+        }
+        if (clusteredShading && !deferredShading) {
+            // only the lights whose bounds reach into the frustum are assigned to clusters
+            updateLightBVH(lightBVH, lightManager);
+            candidateLights.clear();
+            lightBVH.QueryFrustum(frustum, candidateLights);
+            clusteredLighting.Update(view, glm::radians(camera.Zoom), (float)sceneWidth / (float)sceneHeight, 1.1f, 100.0f,
+                                     renderWidth, renderHeight, lightManager.PointLights(), &candidateLights);
+            clusteredLighting.Bind(lightManager);
+        }
 
-        // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glDepthMask(GL_TRUE);
-        glDepthFunc(GL_LESS);
+        sceneBVH.Update();
+        if (pickRequested) {
+            pickRequested = false;
+            BVHHit hit;
+            if (sceneBVH.Raycast(camera.Position, camera.Front, 100.0f, hit))
+                std::cout << "picked: " << sceneObjectNames[hit.userData] << " at " << hit.distance << std::endl;
+            else
+                std::cout << "picked: nothing" << std::endl;
+        }
 
+        renderQueue.Begin(camera.Position, 100.0f);
+        CullStats cullStats;
+        bool visible[SCENE_OBJECT_COUNT] = {false, false, false};
+        visibleObjects.clear();
+        sceneBVH.QueryFrustum(frustum, visibleObjects);
+        for (unsigned int object : visibleObjects)
+            visible[object] = true;
+        if (occlusionCulling) {
+            occlusion.Begin(projection * view, 1.1f);
+            if (visible[SCENE_STONE])
+                occlusion.Draw(stoneOccluder, model1, frustum);
+            if (visible[SCENE_DOG])
+                occlusion.Draw(dogOccluder, model, frustum);
+            if (visible[SCENE_STATUE])
+                occlusion.Draw(statueOccluder, model2, frustum);
+            occlusion.Finish(threadPool);
+            // occluders are tested too, one can be hidden behind another
+            if (visible[SCENE_STONE])
+                visible[SCENE_STONE] = occlusion.IsVisible(stoneBounds.Transform(model1));
+            if (visible[SCENE_DOG])
+                visible[SCENE_DOG] = occlusion.IsVisible(dogModel.bounds.Transform(model));
+            if (visible[SCENE_STATUE])
+                visible[SCENE_STATUE] = occlusion.IsVisible(statueModel.bounds.Transform(model2));
+        }
+        // in forward shading M moves the pets onto the static batch, drawn further down
+        bool indirectPets = indirectDraws && !deferredShading;
+
+        // stone
+        if (visible[SCENE_STONE]) {
+            renderQueue.SubmitArrays(RENDER_PASS_OPAQUE, texShader, stoneMaterial, VAO, 36, sceneTransforms, stoneTransform);
+            cullStats.drawn++;
+        } else {
+            cullStats.culled++;
+        }
 
-        glBindFramebuffer(GL_FRAMEBUFFER,0);
-        glDisable(GL_DEPTH_TEST);
-        glClear(GL_COLOR_BUFFER_BIT);
+        // dog
+        if (!visible[SCENE_DOG])
+            cullStats.culled += dogModel.meshes.size();
+        else if (deferredShading)
+            dogModel.Submit(renderQueue, deferredRenderer.geometryShaders, sceneTransforms, dogTransform, frustum, cullStats,
+                            RENDER_PASS_GEOMETRY);
+        else if (!indirectPets)
+            dogModel.Submit(renderQueue, clusteredShading ? clusteredShaders : litShaders, sceneTransforms, dogTransform, frustum, cullStats);
+
+        // statue
+        if (!visible[SCENE_STATUE])
+            cullStats.culled += statueModel.meshes.size();
+        else if (deferredShading)
+            statueModel.Submit(renderQueue, deferredRenderer.geometryShaders, sceneTransforms, statueTransform, frustum, cullStats,
+                               RENDER_PASS_GEOMETRY);
+        else if (!indirectPets)
+            statueModel.Submit(renderQueue, clusteredShading ? clusteredShaders : litShaders, sceneTransforms, statueTransform,
+                               frustum, cullStats);
+
+        // dog yard and pet entities, instances outside the frustum are left out of the upload
+        if (pets.registry.Alive() > 0)
+            pets.Update(deltaTime, threadPool);
+        if (!yardDogs.empty() || pets.registry.Alive() > 0) {
+            visibleYardDogs.clear();
+            visibleYardStones.clear();
+            for (unsigned int i = 0; i < yardDogs.size(); i++) {
+                if (frustum.Intersects(dogModel.sphere.Transform(yardDogs[i])) &&
+                    (!occlusionCulling || occlusion.IsVisible(dogModel.bounds.Transform(yardDogs[i]))))
+                    visibleYardDogs.push_back(yardDogs[i]);
+                AABB stone = stoneBounds.Transform(yardStones[i]);
+                if (frustum.Intersects(stone) && (!occlusionCulling || occlusion.IsVisible(stone)))
+                    visibleYardStones.push_back(yardStones[i]);
+            }
+            pets.Collect(&dogModel, frustum, visibleYardDogs);
+            visiblePetProps.clear();
+            pets.Collect(&statueModel, frustum, visiblePetProps);
+            yardDogInstances.Upload(visibleYardDogs);
+            yardStoneInstances.Upload(visibleYardStones);
+            if (deferredShading)
+                dogModel.SubmitInstanced(renderQueue, deferredRenderer.geometryShaders, yardDogInstances, RENDER_PASS_GEOMETRY);
+            else if (!indirectPets)
+                dogModel.SubmitInstanced(renderQueue, clusteredShading ? clusteredShaders : litShaders, yardDogInstances);
+            if (!visibleYardStones.empty())
+                renderQueue.SubmitArraysInstanced(RENDER_PASS_OPAQUE, texInstancedShader, stoneMaterial, VAO, 36, visibleYardStones.size());
+            if (!visiblePetProps.empty()) {
+                petPropInstances.Upload(visiblePetProps);
+                if (deferredShading)
+                    statueModel.SubmitInstanced(renderQueue, deferredRenderer.geometryShaders, petPropInstances, RENDER_PASS_GEOMETRY);
+                else if (!indirectPets)
+                    statueModel.SubmitInstanced(renderQueue, clusteredShading ? clusteredShaders : litShaders, petPropInstances);
+            }
+        }
 
+        // everything lit goes into the scene targets, the graph clears them before this runs
+        frameGraph.AddPass("scene", [&](FrameGraph::Builder &pass) {
+            pass.Write(sceneColor);
+            pass.Write(sceneDepth);
+        }, [&](const FrameGraph &graph) {
+            framebuffer = graph.CurrentFramebuffer();
+            glViewport(0, 0, renderWidth, renderHeight);
+            glEnable(GL_DEPTH_TEST);
+            if (!frameDataBound)
+                return;
+
+            // indirect path: drawn right away into the scene framebuffer, before the queue adds the rest.
+            // The deferred path keeps using the queue, its depth is copied over the scene framebuffer.
+            if (indirectPets) {
+                staticBatch.Begin();
+                if (visible[SCENE_DOG])
+                    staticBatch.Add(dogBatchObject, model, frustum, cullStats);
+                if (visible[SCENE_STATUE])
+                    staticBatch.Add(statueBatchObject, model2, frustum, cullStats);
+                for (const glm::mat4 &dog : visibleYardDogs)
+                    staticBatch.Add(dogBatchObject, dog);
+                for (const glm::mat4 &prop : visiblePetProps)
+                    staticBatch.Add(statueBatchObject, prop);
+                staticBatch.Draw(clusteredShading ? clusteredInstancedShader : dogInstancedShader);
+            }
+
+            if (mdiBenchmark.Running()) {
+                std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+                if (mdiBenchmark.Step() == 0) {
+                    benchmarkOffsets.assign(benchmarkObjects.size(), -1);
+                    for (unsigned int i = 0; i < benchmarkObjects.size(); i++)
+                        uploadRing.WriteUniform(&benchmarkObjects[i], sizeof(GpuObjectData), benchmarkOffsets[i]);
+                    uploadRing.Flush();
+                    dogShader.use();
+                    for (unsigned int i = 0; i < benchmarkOffsets.size(); i++) {
+                        // did not fit, the ring is bigger next frame
+                        if (benchmarkOffsets[i] < 0)
+                            continue;
+                        glBindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_OBJECT, uploadRing.ID, benchmarkOffsets[i], sizeof(GpuObjectData));
+                        if (i < benchmarkDogs.size())
+                            dogModel.Draw(dogShader);
+                        else
+                            statueModel.Draw(dogShader);
+                    }
+                } else {
+                    staticBatch.Begin();
+                    for (const glm::mat4 &dog : benchmarkDogs)
+                        staticBatch.Add(dogBatchObject, dog);
+                    for (const glm::mat4 &statue : benchmarkStatues)
+                        staticBatch.Add(statueBatchObject, statue);
+                    staticBatch.Draw(dogInstancedShader);
+                }
+                mdiBenchmark.Frame(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+                if (!mdiBenchmark.Running())
+                    glfwSetWindowShouldClose(window, true);
+            }
+
+            if (uploadBenchmark.Running()) {
+                std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, texture);
+                glBindVertexArray(VAO);
+                if (uploadBenchmark.Step() == 0) {
+                    uploadUniformShader.use();
+                    uploadUniformShader.setInt("texture1", 0);
+                    for (const GpuObjectData &stone : uploadStones) {
+                        uploadUniformShader.set(uploadUniformModel, stone.model);
+                        glDrawArrays(GL_TRIANGLES, 0, 36);
+                    }
+                } else if (uploadBenchmark.Step() == 1) {
+                    texShader.use();
+                    texShader.setInt("texture1", 0);
+                    glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_OBJECT, objectUBO);
+                    glBindBuffer(GL_UNIFORM_BUFFER, objectUBO);
+                    for (const GpuObjectData &stone : uploadStones) {
+                        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(GpuObjectData), &stone);
+                        glDrawArrays(GL_TRIANGLES, 0, 36);
+                    }
+                    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+                } else {
+                    uploadOffsets.assign(uploadStones.size(), -1);
+                    for (unsigned int i = 0; i < uploadStones.size(); i++)
+                        uploadRing.WriteUniform(&uploadStones[i], sizeof(GpuObjectData), uploadOffsets[i]);
+                    uploadRing.Flush();
+                    texShader.use();
+                    texShader.setInt("texture1", 0);
+                    for (GLintptr offset : uploadOffsets) {
+                        if (offset < 0)
+                            continue;
+                        glBindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_OBJECT, uploadRing.ID, offset, sizeof(GpuObjectData));
+                        glDrawArrays(GL_TRIANGLES, 0, 36);
+                    }
+                }
+                glBindVertexArray(0);
+                uploadBenchmark.Frame(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+                if (!uploadBenchmark.Running())
+                    glfwSetWindowShouldClose(window, true);
+            }
+
+            if (normalMatrixBenchmark.Running()) {
+                Shader &shader = normalMatrixBenchmark.Step() == 0 ? dogShader : inverseNormalShader;
+                benchmarkTransforms.Upload(uploadRing);
+                glBeginQuery(GL_TIME_ELAPSED, normalMatrixQueries[normalMatrixFrame % 2]);
+                shader.use();
+                for (unsigned int i = 0; i < benchmarkTransforms.Count(); i++) {
+                    if (benchmarkTransforms.Offset(i) < 0)
+                        continue;
+                    glBindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_OBJECT, uploadRing.ID, benchmarkTransforms.Offset(i),
+                                      sizeof(GpuObjectData));
+                    dogModel.Draw(shader);
+                }
+                glEndQuery(GL_TIME_ELAPSED);
+                // the previous frame's query is read, so this does not wait for the draws just issued
+                if (normalMatrixFrame > 0) {
+                    GLuint64 elapsed = 0;
+                    glGetQueryObjectui64v(normalMatrixQueries[(normalMatrixFrame - 1) % 2], GL_QUERY_RESULT, &elapsed);
+                    normalMatrixBenchmark.Frame(elapsed / 1000000.0);
+                }
+                normalMatrixFrame++;
+                if (!normalMatrixBenchmark.Running())
+                    glfwSetWindowShouldClose(window, true);
+            }
+
+            // skybox is in its own pass so it is drawn last
+            renderQueue.SubmitArrays(RENDER_PASS_SKYBOX, skyboxShader, skyboxMaterial, skyboxVAO, 36);
+
+            renderQueue.Execute();
+        });
+
+        // the scene is upscaled here when it was rendered at a lower resolution. Both paths cover
+        // the whole window, so it is not cleared first
+        frameGraph.AddPass("composite", [&](FrameGraph::Builder &pass) {
+            pass.Read(sceneColor);
+            pass.Write(backbuffer);
+        }, [&](const FrameGraph &graph) {
+            glDisable(GL_DEPTH_TEST);
+            if (blur) {
+                blurChain.Apply(graph.Texture(sceneColor), sceneWidth, sceneHeight, 0, sceneUvScale);
+            } else {
+                framebuffersShader.use();
+                framebuffersShader.set(framebuffersUvScale, sceneUvScale);
+                glBindVertexArray(quadVAO);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, graph.Texture(sceneColor));
+                glDrawArrays(GL_TRIANGLES,0,6);
+            }
+        });
+
+        // occlusion buffer in the lower left corner, at its own resolution
+        if (occlusionCulling && occlusionDebug) {
+            frameGraph.AddPass("occlusion debug", [&](FrameGraph::Builder &pass) {
+                pass.Write(backbuffer);
+            }, [&](const FrameGraph &) {
+                glViewport(0, 0, OcclusionCuller::WIDTH, OcclusionCuller::HEIGHT);
+                occlusionDebugShader.use();
+                glBindVertexArray(quadVAO);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, occlusion.UploadDebugTexture());
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+            });
+        }
 
-        framebuffersShader.use();
-        framebuffersShader.setInt("blur", blur);
-        glBindVertexArray(quadVAO);
-        glBindTexture(GL_TEXTURE_2D,textureColorbuffer);
-        glDrawArrays(GL_TRIANGLES,0,6);
+        frameGraph.Execute();
+        gpuProfiler.EndFrame();
+
+        statsTimer += deltaTime;
+        if (statsTimer >= 1.0f) {
+            statsTimer = 0.0f;
+            const RenderQueueStats &stats = renderQueue.stats;
+            std::cout << "render queue: " << stats.packets << " packets, " << stats.StateChanges() << " state changes ("
+                      << stats.programChanges << " program, " << stats.materialChanges << " material, "
+                      << stats.vaoChanges << " vao), " << stats.unsortedStateChanges << " unsorted, "
+                      << stats.naiveStateChanges << " without redundancy checks, " << stats.drawCalls << " draw calls for "
+                      << stats.instances << " instances";
+            if (stats.dropped > 0)
+                std::cout << ", " << stats.dropped << " dropped for lack of ring space";
+            std::cout << std::endl;
+            if (indirectPets)
+                std::cout << "indirect: " << staticBatch.stats.draws << " draws as " << staticBatch.stats.commands
+                          << " commands in " << staticBatch.stats.drawCalls << " draw calls for "
+                          << staticBatch.stats.materialGroups << " materials" << std::endl;
+            if (!yardDogs.empty() || pets.registry.Alive() > 0)
+                std::cout << "dog yard: " << visibleYardDogs.size() << " of " << yardDogs.size() + pets.stats.pets
+                          << " dogs visible" << std::endl;
+            if (pets.registry.Alive() > 0)
+                std::cout << "pets: " << pets.stats.pets << " pets and " << pets.stats.props << " props, updated in "
+                          << pets.stats.updateMs << " ms" << std::endl;
+            std::cout << "upload ring: " << (uploadRing.Persistent() ? "persistent" : "mapped per frame") << ", "
+                      << uploadRing.stalls << " stalls, " << uploadRing.FrameSize() / 1024 << " KB per frame";
+            if (uploadRing.overflows > 0)
+                std::cout << ", grew " << uploadRing.grows << " times after " << uploadRing.overflows << " writes that did not fit";
+            std::cout << std::endl;
+            if (occlusionCulling)
+                std::cout << "occlusion: " << occlusion.stats.occluded << " of " << occlusion.stats.tested
+                          << " tested bounds hidden, " << occlusion.stats.occluderTriangles << " occluder triangles in "
+                          << occlusion.stats.rasterMs << " ms" << std::endl;
+            std::cout << "shadows:";
+            for (unsigned int i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+                const ShadowCascadeStats &cascade = shadows.stats.cascades[i];
+                std::cout << " cascade " << i << " " << cascade.cpuMs << " ms cpu, " << cascade.gpuMs << " ms gpu"
+                          << (cascade.staticRebuilt ? " (static redrawn)" : "") << (i + 1 < SHADOW_CASCADE_COUNT ? ";" : "");
+            }
+            std::cout << std::endl;
+            std::cout << "culling: " << cullStats.drawn << " meshes drawn, " << cullStats.culled << " culled" << std::endl;
+            if (clusteredShading && !deferredShading) {
+                const ClusterStats &clusters = clusteredLighting.stats;
+                std::cout << "clusters: " << clusters.visibleLights << " of " << lightManager.PointLightCount()
+                          << " lights visible, " << clusters.lightIndices << " light indices, max "
+                          << clusters.maxLightsPerCluster << " per cluster, " << clusters.overflowedClusters
+                          << " overflowed, assigned in " << clusters.assignMs << " ms" << std::endl;
+            }
+            std::cout << "shader variants: " << litShaders.Variants() << " lit, " << clusteredShaders.Variants()
+                      << " clustered, " << deferredRenderer.geometryShaders.Variants() << " deferred geometry, "
+                      << shaders.stats.programs << " programs in the registry (" << shaders.stats.shared << " shared)"
+                      << std::endl;
+            const FrameGraphStats &graph = frameGraph.stats;
+            std::cout << "frame graph: " << graph.passes - graph.culledPasses << " of " << graph.passes << " passes run, "
+                      << graph.transients << " transient targets, " << graph.clears << " clears (" << graph.skippedClears
+                      << " skipped), " << graph.binds << " framebuffer binds (" << graph.skippedBinds << " skipped)" << std::endl;
+            const RenderTargetStats &targets = renderTargets.stats;
+            std::cout << "render targets: " << targets.targets << " textures, " << targets.framebuffers << " framebuffers, "
+                      << targets.bytes / (1024.0 * 1024.0) << " MB (peak " << targets.peakBytes / (1024.0 * 1024.0)
+                      << " MB), " << targets.allocations << " allocated and " << targets.reuses
+                      << " reused this frame" << std::endl;
+            std::cout << "gpu:";
+            for (const GpuTimingStats &scope : gpuProfiler.Stats())
+                std::cout << " " << std::string(scope.depth, '>') << scope.name << " " << scope.avgMs << " ms (p95 "
+                          << scope.p95Ms << ")";
+            std::cout << std::endl;
+            if (dynamicResolutionEnabled) {
+                const DynamicResolutionStats &resolution = dynamicResolution.stats;
+                std::cout << "dynamic resolution: scale " << resolution.scale << " (" << renderWidth << "x" << renderHeight
+                          << "), " << resolution.gpuMs << " ms gpu, " << resolution.frameMs << " ms frame, target "
+                          << resolution.targetMs << " ms, " << resolution.changes << " size changes" << std::endl;
+            }
+        }
 
+        // nothing after this reads the ring regions of this frame
+        uploadRing.EndFrame();
+        if (dynamicResolutionEnabled)
+            dynamicResolution.EndFrame(deltaTime * 1000.0);
 
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
@@ -540,10 +1189,15 @@ int main() {
 
 
 
+    if (gpuProfileDump && gpuProfiler.WriteCsv("gpu_profile.csv") && gpuProfiler.WriteJson("gpu_profile.json"))
+        std::cout << "gpu profile written to gpu_profile.csv and gpu_profile.json" << std::endl;
+
     glDeleteVertexArrays(1, &skyboxVAO);
     glDeleteBuffers(1, &skyboxVBO);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+    renderTargets.Destroy();
+    gpuProfiler.Destroy();
 
 
     //
@@ -590,11 +1244,60 @@ void processInput(GLFWwindow *window) {
         blurKeyPressed = false;
     }
 
+    if(glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS && !clusteredKeyPressed){
+        clusteredShading = !clusteredShading;
+        clusteredKeyPressed = true;
+    }
+
+    if(glfwGetKey(window, GLFW_KEY_C) == GLFW_RELEASE){
+        clusteredKeyPressed = false;
+    }
+
+    if(glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS && !deferredKeyPressed){
+        deferredShading = !deferredShading;
+        deferredKeyPressed = true;
+    }
+
+    if(glfwGetKey(window, GLFW_KEY_G) == GLFW_RELEASE){
+        deferredKeyPressed = false;
+    }
+
+    if(glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS && !indirectKeyPressed){
+        indirectDraws = !indirectDraws;
+        indirectKeyPressed = true;
+    }
+
+    if(glfwGetKey(window, GLFW_KEY_M) == GLFW_RELEASE){
+        indirectKeyPressed = false;
+    }
+
+    if(glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS && !occlusionKeyPressed){
+        occlusionCulling = !occlusionCulling;
+        occlusionKeyPressed = true;
+    }
+
+    if(glfwGetKey(window, GLFW_KEY_O) == GLFW_RELEASE){
+        occlusionKeyPressed = false;
+    }
+
+    if(glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS && !occlusionDebugKeyPressed){
+        occlusionDebug = !occlusionDebug;
+        occlusionDebugKeyPressed = true;
+    }
+
+    if(glfwGetKey(window, GLFW_KEY_B) == GLFW_RELEASE){
+        occlusionDebugKeyPressed = false;
+    }
+
 
 }
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
-
+    // a minimized window reports 0 x 0, the last size is kept until it comes back
+    if (width > 0 && height > 0) {
+        framebufferWidth = width;
+        framebufferHeight = height;
+    }
     glViewport(0, 0, width, height);
 }
 
@@ -619,7 +1322,8 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
 }
 
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
-
+    if (key == GLFW_KEY_P && action == GLFW_PRESS)
+        pickRequested = true;
 }
 unsigned int loadCubemap(vector<std::string> faces)
 {
@@ -651,5 +1355,356 @@ unsigned int loadCubemap(vector<std::string> faces)
     return textureID;
 }
 
+// spreads point lights on rings around the pets, the first one is the scene's regular light
+void setBenchmarkLights(LightManager &lights, unsigned int count)
+{
+    PointLight light;
+    light.position = glm::vec3 (4.0f, 4.0f, 0.0f);
+    light.ambient = glm::vec3 (1.0f, 0.6f, 0.2f);
+    light.diffuse = glm::vec3 (0.9f, 0.5f, 0.6f);
+    light.specular = glm::vec3 (1.0f, 1.0f, 1.0f);
+    light.constant = 1.0f;
+    light.linear = 0.09f;
+    light.quadratic = 0.032f;
+
+    lights.ClearPointLights();
+    lights.AddPointLight(light);
+    for (unsigned int i = 1; i < count; i++) {
+        float angle = glm::radians(137.5f * i);
+        float radius = 1.0f + 0.02f * i;
+        light.position = glm::vec3(radius * cos(angle), -0.5f + 0.01f * (i % 100), radius * sin(angle));
+        light.ambient = glm::vec3(0.0f);
+        light.diffuse = glm::vec3(0.5f + 0.5f * sin(angle), 0.5f + 0.5f * cos(angle), 0.5f);
+        light.specular = light.diffuse;
+        lights.AddPointLight(light);
+    }
+}
+
+// small lights on orbits around the pets, moved every frame
+void setStressLights(LightManager &lights, unsigned int count, float time)
+{
+    PointLight light;
+    light.ambient = glm::vec3(0.0f);
+    light.constant = 1.0f;
+    light.linear = 14.0f;
+    light.quadratic = 200.0f;
+
+    if (lights.PointLightCount() != count) {
+        lights.ClearPointLights();
+        for (unsigned int i = 0; i < count; i++)
+            lights.AddPointLight(light);
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        float phase = glm::radians(137.5f * i);
+        float speed = 0.2f + 0.6f * ((i * 7919) % 100) / 100.0f;
+        float radius = 0.3f + 2.2f * ((i * 104729) % 1000) / 1000.0f;
+        float angle = phase + time * speed;
+        light.position = glm::vec3(0.3f + radius * cos(angle), -1.0f + 2.0f * ((i * 31) % 64) / 64.0f + 0.2f * sin(time + phase),
+                                   0.2f + radius * sin(angle));
+        light.diffuse = glm::vec3(0.5f + 0.5f * sin(phase), 0.5f + 0.5f * sin(phase + 2.1f), 0.5f + 0.5f * sin(phase + 4.2f));
+        light.specular = light.diffuse;
+        lights.SetPointLight(i, light);
+    }
+}
+
+bool hasArgument(int argc, char **argv, const std::string &argument)
+{
+    for (int i = 1; i < argc; i++)
+        if (argument == argv[i])
+            return true;
+    return false;
+}
+
+// value following an argument, e.g. "--cluster-stress 8192", defaultValue when it is missing
+unsigned int argumentValue(int argc, char **argv, const std::string &argument, unsigned int defaultValue)
+{
+    for (int i = 1; i + 1 < argc; i++) {
+        if (argument != argv[i] || !isdigit(argv[i + 1][0]))
+            continue;
+        // the whole value has to be a number that fits, anything else keeps the default
+        errno = 0;
+        char *end = nullptr;
+        unsigned long value = std::strtoul(argv[i + 1], &end, 10);
+        if (errno != 0 || *end != '\0' || value > UINT_MAX) {
+            std::cout << "ERROR::ARGUMENT: " << argument << " " << argv[i + 1] << " is not a valid count, using "
+                      << defaultValue << std::endl;
+            return defaultValue;
+        }
+        return (unsigned int)value;
+    }
+    return defaultValue;
+}
+
+// one box per point light, rebuilt when lights were added or removed and refitted when they were changed
+void updateLightBVH(BVH &bvh, const LightManager &lights)
+{
+    static unsigned int syncedUploads = ~0u;
+    const std::vector<PointLight> &pointLights = lights.PointLights();
+    if (bvh.ObjectCount() != pointLights.size()) {
+        bvh.Clear();
+        for (unsigned int i = 0; i < pointLights.size(); i++) {
+            glm::vec3 radius(PointLightRadius(pointLights[i]));
+            bvh.Add(AABB(pointLights[i].position - radius, pointLights[i].position + radius), i);
+        }
+    } else if (lights.uploads != syncedUploads) {
+        // ids match the light indices, they were added in order into an empty BVH
+        for (unsigned int i = 0; i < pointLights.size(); i++) {
+            glm::vec3 radius(PointLightRadius(pointLights[i]));
+            bvh.Move(i, AABB(pointLights[i].position - radius, pointLights[i].position + radius));
+        }
+    }
+    syncedUploads = lights.uploads;
+    bvh.Update();
+}
+
+// builds BVHs over 10k to 100k random boxes and compares their queries against testing every box
+void runBVHBenchmark()
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    const unsigned int queries = 1000;
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    std::cout << std::setw(10) << "objects" << std::setw(10) << "nodes" << std::setw(10) << "build ms"
+              << std::setw(10) << "refit ms" << std::setw(14) << "frustum us" << std::setw(14) << "linear us"
+              << std::setw(14) << "sphere us" << std::setw(14) << "linear us" << std::setw(14) << "ray us"
+              << std::setw(14) << "linear us" << std::endl;
+    for (unsigned int count : {10000u, 25000u, 50000u, 100000u}) {
+        // same density for every count, boxes between 0.2 and 2 units wide
+        float side = 4.0f * std::cbrt((float)count);
+        std::vector<AABB> boxes(count);
+        BVH bvh;
+        for (unsigned int i = 0; i < count; i++) {
+            glm::vec3 center(unit(random) * side, unit(random) * side, unit(random) * side);
+            glm::vec3 extents = glm::vec3(0.1f) + 0.9f * glm::vec3(unit(random), unit(random), unit(random));
+            boxes[i] = AABB(center - extents, center + extents);
+            bvh.Add(boxes[i], i);
+        }
+
+        Clock::time_point start = Clock::now();
+        bvh.Build();
+        double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        // every object drifts a little, like a frame of animation
+        for (unsigned int i = 0; i < count; i++) {
+            glm::vec3 offset = 0.2f * glm::vec3(unit(random), unit(random), unit(random)) - glm::vec3(0.1f);
+            boxes[i] = AABB(boxes[i].min + offset, boxes[i].max + offset);
+            bvh.Move(i, boxes[i]);
+        }
+        start = Clock::now();
+        bvh.Refit();
+        double refitMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        // cameras in the middle of the volume looking in random directions
+        glm::vec3 middle(side * 0.5f);
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, side * 0.5f);
+        std::vector<Frustum> frustums;
+        std::vector<BoundingSphere> spheres;
+        std::vector<glm::vec3> origins, directions;
+        for (unsigned int i = 0; i < queries; i++) {
+            glm::vec3 direction = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) - glm::vec3(0.5f));
+            frustums.push_back(Frustum(projection * glm::lookAt(middle, middle + direction, glm::vec3(0.0f, 1.0f, 0.0f))));
+            spheres.push_back(BoundingSphere(glm::vec3(unit(random), unit(random), unit(random)) * side, 5.0f));
+            origins.push_back(glm::vec3(unit(random), unit(random), unit(random)) * side);
+            directions.push_back(direction);
+        }
+
+        std::vector<unsigned int> result;
+        // the linear loops only count, so they are not charged for filling a result list
+        unsigned int found = 0;
+        start = Clock::now();
+        for (const Frustum &frustum : frustums) {
+            result.clear();
+            bvh.QueryFrustum(frustum, result);
+        }
+        double frustumUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / queries;
+        start = Clock::now();
+        for (const Frustum &frustum : frustums)
+            for (const AABB &box : boxes)
+                found += frustum.Intersects(box);
+        double frustumLinearUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / queries;
+
+        start = Clock::now();
+        for (const BoundingSphere &sphere : spheres) {
+            result.clear();
+            bvh.QuerySphere(sphere, result);
+        }
+        double sphereUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / queries;
+        start = Clock::now();
+        for (const BoundingSphere &sphere : spheres)
+            for (const AABB &box : boxes)
+                found += Overlaps(box, sphere);
+        double sphereLinearUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / queries;
+
+        BVHHit hit;
+        start = Clock::now();
+        for (unsigned int i = 0; i < queries; i++)
+            found += bvh.Raycast(origins[i], directions[i], side, hit);
+        double rayUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / queries;
+        start = Clock::now();
+        for (unsigned int i = 0; i < queries; i++) {
+            glm::vec3 inverseDirection = 1.0f / directions[i];
+            float closest = side;
+            for (const AABB &box : boxes)
+                closest = std::min(closest, IntersectRay(box, origins[i], inverseDirection, closest));
+            found += closest < side;
+        }
+        double rayLinearUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / queries;
+
+        std::cout << std::setw(10) << count << std::setw(10) << bvh.NodeCount() << std::setw(10) << buildMs
+                  << std::setw(10) << refitMs << std::setw(14) << frustumUs << std::setw(14) << frustumLinearUs
+                  << std::setw(14) << sphereUs << std::setw(14) << sphereLinearUs << std::setw(14) << rayUs
+                  << std::setw(14) << rayLinearUs << std::endl;
+        if (found == 0)
+            std::cout << "nothing was hit" << std::endl;
+    }
+}
 
-    
\ No newline at end of file
+// rebuilds 10k to 1M world and normal matrices with chained glm calls and a general inverse, then with
+// TransformSystem with every entry dirty and with 10% of them dirty
+void runTransformBenchmark()
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    const unsigned int repeats = 5;
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    std::cout << std::setw(10) << "objects" << std::setw(12) << "glm ms" << std::setw(12) << "glm M/s"
+              << std::setw(12) << "soa ms" << std::setw(12) << "soa M/s" << std::setw(14) << "10% dirty ms"
+              << std::setw(12) << "recomputed" << std::endl;
+    for (unsigned int count : {10000u, 100000u, 1000000u}) {
+        std::vector<glm::vec3> positions(count), axes(count), scales(count);
+        std::vector<float> angles(count);
+        TransformSystem transforms;
+        for (unsigned int i = 0; i < count; i++) {
+            positions[i] = glm::vec3(unit(random), unit(random), unit(random)) * 100.0f;
+            axes[i] = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.01f));
+            angles[i] = unit(random) * 6.2832f;
+            scales[i] = glm::vec3(0.5f) + glm::vec3(unit(random), unit(random), unit(random));
+            transforms.Create(positions[i]);
+            transforms.SetRotation(i, angles[i], axes[i]);
+            transforms.SetScale(i, scales[i]);
+        }
+        std::vector<glm::mat4> world(count), normal(count);
+
+        // best of a few runs, the first one also pays for page faults
+        double glmMs = 1e30, soaMs = 1e30, partialMs = 1e30;
+        unsigned int recomputed = 0;
+        for (unsigned int run = 0; run < repeats; run++) {
+            Clock::time_point start = Clock::now();
+            for (unsigned int i = 0; i < count; i++) {
+                glm::mat4 model = glm::translate(glm::mat4(1.0f), positions[i]);
+                model = glm::rotate(model, angles[i], axes[i]);
+                world[i] = glm::scale(model, scales[i]);
+                normal[i] = NormalMatrix(world[i]);
+            }
+            glmMs = std::min(glmMs, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+
+            transforms.Invalidate();
+            start = Clock::now();
+            transforms.Update();
+            soaMs = std::min(soaMs, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+
+            // moving the entries is part of the cost, marking them dirty is not free
+            std::uniform_int_distribution<unsigned int> pick(0, count - 1);
+            std::vector<unsigned int> moved(count / 10);
+            for (unsigned int &id : moved)
+                id = pick(random);
+            start = Clock::now();
+            for (unsigned int id : moved)
+                transforms.SetPosition(id, positions[id] + glm::vec3(0.0f, 0.1f, 0.0f));
+            recomputed = transforms.Update();
+            partialMs = std::min(partialMs, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+
+        // the results are compared so neither loop can be optimized away
+        float error = 0.0f;
+        for (unsigned int i = 0; i < count; i += 97)
+            for (int column = 0; column < 3; column++)
+                error = std::max(error, glm::length(normal[i][column] - transforms.Normal(i)[column]));
+        std::cout << std::setw(10) << count << std::setw(12) << glmMs << std::setw(12) << count / glmMs / 1000.0
+                  << std::setw(12) << soaMs << std::setw(12) << count / soaMs / 1000.0 << std::setw(14) << partialMs
+                  << std::setw(12) << recomputed << std::endl;
+        if (error > 1e-3f)
+            std::cout << "ERROR::TRANSFORMS::MISMATCH " << error << std::endl;
+    }
+}
+
+// the same behaviour on one heap object per pet behind a virtual call, the layout the ECS replaces
+struct PetObject {
+    Wander wander;
+    PetTransform transform;
+    virtual ~PetObject() {}
+    virtual void Update(float deltaTime) { PetSimulation::Step(wander, transform, deltaTime); }
+};
+
+// times the pet behaviours over count entities, on one thread, on the pool and as separate objects,
+// and the gather of visible instances
+void runEcsBenchmark(unsigned int count)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    const unsigned int frames = 10;
+    const float deltaTime = 1.0f / 60.0f;
+    ThreadPool threads;
+    ThreadPool singleThread(1);
+
+    // a tenth of the entities are props without behaviour
+    Renderable renderable = {nullptr, BoundingSphere(glm::vec3(0.0f), 50.0f)};
+    unsigned int columns = (unsigned int)std::ceil(std::sqrt((float)count));
+    PetSimulation pets;
+    Clock::time_point start = Clock::now();
+    for (unsigned int i = 0; i < count; i++) {
+        glm::vec3 home((float)(i % columns) * 2.0f - columns, 0.0f, -(float)(i / columns) * 2.0f);
+        if (i % 10 == 9)
+            pets.SpawnProp(renderable, home, 0.0f, 0.01f);
+        else
+            pets.SpawnPet(renderable, home, 0.01f, i * 2654435761u);
+    }
+    double createMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    std::vector<std::unique_ptr<PetObject>> objects;
+    Registry &registry = pets.registry;
+    registry.Each<Wander, PetTransform>([&](Entity, Wander &wander, PetTransform &transform) {
+        objects.push_back(std::unique_ptr<PetObject>(new PetObject()));
+        objects.back()->wander = wander;
+        objects.back()->transform = transform;
+    });
+    // scene lists are rarely in allocation order
+    std::shuffle(objects.begin(), objects.end(), std::mt19937(42));
+
+    start = Clock::now();
+    for (unsigned int frame = 0; frame < frames; frame++)
+        pets.Update(deltaTime, singleThread);
+    double singleMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+
+    start = Clock::now();
+    for (unsigned int frame = 0; frame < frames; frame++)
+        pets.Update(deltaTime, threads);
+    double parallelMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+
+    start = Clock::now();
+    for (unsigned int frame = 0; frame < frames; frame++)
+        for (std::unique_ptr<PetObject> &object : objects)
+            object->Update(deltaTime);
+    double objectMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+
+    // a camera above the first rows of the yard
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+    Frustum frustum(projection * glm::lookAt(glm::vec3(0.0f, 10.0f, 10.0f), glm::vec3(0.0f, 0.0f, -20.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+    std::vector<glm::mat4> visible;
+    start = Clock::now();
+    for (unsigned int frame = 0; frame < frames; frame++) {
+        visible.clear();
+        pets.Collect(nullptr, frustum, visible);
+    }
+    double collectMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+
+    std::cout << count << " entities, " << pets.stats.pets << " pets, " << threads.ThreadCount() << " threads" << std::endl;
+    std::cout << std::setw(20) << "step" << std::setw(12) << "ms" << std::setw(14) << "M entities/s" << std::endl;
+    std::cout << std::setw(20) << "create" << std::setw(12) << createMs << std::setw(14) << count / createMs / 1000.0 << std::endl;
+    std::cout << std::setw(20) << "update, 1 thread" << std::setw(12) << singleMs << std::setw(14) << pets.stats.pets / singleMs / 1000.0 << std::endl;
+    std::cout << std::setw(20) << "update, pool" << std::setw(12) << parallelMs << std::setw(14) << pets.stats.pets / parallelMs / 1000.0 << std::endl;
+    std::cout << std::setw(20) << "update, objects" << std::setw(12) << objectMs << std::setw(14) << pets.stats.pets / objectMs / 1000.0 << std::endl;
+    std::cout << std::setw(20) << "collect" << std::setw(12) << collectMs << std::setw(14) << count / collectMs / 1000.0
+              << "  (" << visible.size() << " visible)" << std::endl;
+}